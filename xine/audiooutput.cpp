@@ -280,7 +280,7 @@ bool AudioOutput::setOutputDevice(const AudioOutputDevice &newDevice)
         return false;
     }
 
-    KeepReference<> *keep = new KeepReference<>;
+    KeepReference<> *keep = new KeepReference<>(source() ? source()->streamThread() : 0);
     keep->addObject(xt);
     keep->ready();
 
@@ -296,7 +296,7 @@ bool AudioOutput::setOutputDevice(const AudioOutputDevice &newDevice)
         QList<WireCall> unwireCall;
         wireCall << WireCall(src, this);
         unwireCall << WireCall(src, QExplicitlySharedDataPointer<SinkNodeXT>(xt));
-        QCoreApplication::postEvent(XineThread::instance(), new RewireEvent(wireCall, unwireCall));
+        XineThread::postRewire(wireCall, unwireCall);
         graphChanged();
     }
 
@@ -338,7 +338,7 @@ void AudioOutput::aboutToChangeXineEngine()
         xt2->m_xine = xt->m_xine;
         xt2->m_audioPort = xt->m_audioPort;
         xt->m_audioPort = 0;
-        KeepReference<> *keep = new KeepReference<>;
+        KeepReference<> *keep = new KeepReference<>(source() ? source()->streamThread() : 0);
         keep->addObject(xt2);
         keep->ready();
     }
@@ -34,12 +34,19 @@
 #include "videowidget.h"
 #include "wirecall.h"
 #include "xinethread.h"
+#include "xineenginepool.h"
 #include "keepreference.h"
 #include "sinknode.h"
 #include "sourcenode.h"
+#include "bytestream.h"
+#include "mediaprobe.h"
+#include "metadatacache.h"
+#include "plugincatalog.h"
 #include "config-xine-widget.h"
 
+#include <QtCore/QDir>
 #include <QtCore/QByteArray>
+#include <QtCore/QHash>
 #include <QtCore/QThread>
 #include <QtDBus/QDBusConnection>
 #include <QtGui/QApplication>
@@ -63,11 +70,52 @@ Backend *Backend::instance()
     return s_instance;
 }
 
+/**
+ * The caches are shared by all applications, so they go to the XDG cache directory.
+ */
+static QString cacheFilePath(const char *name)
+{
+    QString directory = QFile::decodeName(qgetenv("XDG_CACHE_HOME"));
+    if (directory.isEmpty()) {
+        directory = QDir::home().filePath(QLatin1String(".cache"));
+    }
+    return QDir(directory).filePath(QLatin1String(name));
+}
+
+/**
+ * Creates the engine that is shared by the effects and outputs, and reads the plugin catalog
+ * from it. xine_init scans the plugins, which can take seconds on a cold start.
+ */
+class Backend::EngineInitThread : public QThread
+{
+    public:
+        EngineInitThread(Backend *backend) : m_backend(backend) {}
+
+        const PluginCatalog &catalog() const { return m_catalog; }
+
+    protected:
+        void run()
+        {
+            m_backend->m_xine.create();
+            // the first stream uses this engine, too
+            m_backend->m_enginePool->addExpectedEngine(m_backend->m_xine);
+            m_catalog = PluginCatalog::fromEngine(m_backend->m_xine);
+        }
+
+    private:
+        Backend *const m_backend;
+        PluginCatalog m_catalog;
+};
+
 Backend::Backend(QObject *parent, const QVariantList &)
     : QObject(parent),
+    m_metaDataCache(0),
+    m_enginePool(0),
+    m_engineInit(0),
+    m_pluginCatalogValid(false),
+    m_engineInitialized(false),
     m_inShutdown(false),
-    m_debugMessages(!qgetenv("PHONON_XINE_DEBUG").isEmpty()),
-    m_thread(0)
+    m_debugMessages(!qgetenv("PHONON_XINE_DEBUG").isEmpty())
 {
     // Initialise PulseAudio support
     PulseSupport *pulse = PulseSupport::getInstance();
@@ -77,9 +125,6 @@ Backend::Backend(QObject *parent, const QVariantList &)
     Q_ASSERT(s_instance == 0);
     s_instance = this;
 
-    m_xine.create();
-    m_freeEngines << m_xine;
-
     setProperty("identifier",     QLatin1String("phonon_xine"));
     setProperty("backendName",    QLatin1String("Xine"));
     setProperty("backendComment", tr("Phonon Xine Backend"));
@@ -92,6 +137,51 @@ Backend::Backend(QObject *parent, const QVariantList &)
     m_deinterlaceVCD = cg.value("Settings/deinterlaceVCD", false).toBool();
     m_deinterlaceFile = cg.value("Settings/deinterlaceFile", false).toBool();
     m_deinterlaceMethod = cg.value("Settings/deinterlaceMethod", 0).toInt();
+    // how many bytes of already read stream data are kept for backward seeks
+    m_byteStreamHistorySize = cg.value("Settings/byteStreamHistorySize", 512 * 1024).toInt();
+    // how many milliseconds of ByteStream data are buffered before the application is told to
+    // stop sending data
+    m_byteStreamBufferTime = cg.value("Settings/byteStreamBufferTime", 4000).toInt();
+    // how many bytes of ByteStream data may be cached on disk, 0 disables the cache
+    m_streamCacheSize = cg.value("Settings/streamCacheSize", 0).toLongLong();
+    m_streamCacheDirectory = cg.value("Settings/streamCacheDirectory", QDir::tempPath()).toString();
+    // 1: all streams share one XineThread, 0: one XineThread per stream, N: up to N XineThreads
+    m_xineThreadCount = cg.value("Settings/xineThreads", 1).toInt();
+    // how many milliseconds xine_open may take before opening the media is given up, 0 waits forever
+    m_openTimeout = cg.value("Settings/openTimeout", 30000).toInt();
+    // how many milliseconds before the end of a source gapless playback asks for the next one, so
+    // that it can be opened while the current one still plays. 0 asks at the end
+    m_gaplessPrerollTime = cg.value("Settings/gaplessPrerollTime", 3000).toInt();
+    // how many closed xine streams each engine keeps for reuse, 0 disposes them right away
+    m_streamPoolSize = cg.value("Settings/streamPoolSize", 2).toInt();
+    // how many free xine engines are created ahead of time, so that new streams don't wait for
+    // xine_init, and how many are kept at most
+    const int enginePoolMinSize = cg.value("Settings/enginePoolMinSize", 1).toInt();
+    const int enginePoolMaxSize = cg.value("Settings/enginePoolMaxSize", 5).toInt();
+    m_enginePool = new XineEnginePool(enginePoolMinSize, enginePoolMaxSize);
+    // how many threads a MediaProbe opens MRLs with, 0 uses one per CPU core
+    m_probeThreadCount = cg.value("Settings/probeThreads", 0).toInt();
+    // how many bytes the persistent cache of stream info and meta data of local files may use, 0
+    // disables the cache
+    const qint64 metaDataCacheSize = cg.value("Settings/metaDataCacheSize", 1024 * 1024).toLongLong();
+    if (metaDataCacheSize > 0) {
+        m_metaDataCache = new MetaDataCache(
+                cg.value("Settings/metaDataCacheFile", cacheFilePath("phonon-xine-metadata")).toString(),
+                metaDataCacheSize);
+        if (!m_metaDataCache->isValid()) {
+            delete m_metaDataCache;
+            m_metaDataCache = 0;
+        }
+    }
+
+    // the saved catalog answers the queries about the plugins until xine_init is done, then it
+    // is checked against the real plugins
+    m_pluginCatalogValid = m_pluginCatalog.load(cacheFilePath("phonon-xine-plugins"));
+    m_engineInit = new EngineInitThread(this);
+    connect(m_engineInit, SIGNAL(finished()), SLOT(engineInitialized()));
+    // streams created before xine_init is done wait for this engine instead of creating their own
+    m_enginePool->expectEngine();
+    m_engineInit->start();
 
     signalTimer.setSingleShot(true);
     connect(&signalTimer, SIGNAL(timeout()), SLOT(emitAudioOutputDeviceChange()));
@@ -103,48 +193,114 @@ Backend::Backend(QObject *parent, const QVariantList &)
 Backend::~Backend()
 {
     m_inShutdown = true;
-
-    if (!m_cleanupObjects.isEmpty()) {
-        Q_ASSERT(m_thread);
-        QCoreApplication::postEvent(m_thread, new Event(Event::Cleanup));
-        while (!m_cleanupObjects.isEmpty()) {
+    m_engineInit->wait();
+
+    // every thread deletes the objects that live in it
+    QList<XineThread *> cleanupThreads;
+    foreach (XineThread *thread, m_threads) {
+        if (thread->hasCleanupObjects()) {
+            QCoreApplication::postEvent(thread, new Event(Event::Cleanup));
+            cleanupThreads << thread;
+        }
+    }
+    foreach (XineThread *thread, cleanupThreads) {
+        while (thread->hasCleanupObjects()) {
             XineThread::msleep(200); // static QThread::msleep, but that one is protected and XineThread is our friend
         }
     }
 
-    if (m_thread) {
-        m_thread->quit();
-        m_thread->wait();
-        delete m_thread;
+    foreach (XineThread *thread, m_threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
     }
+    m_threads.clear();
+
+    // no XineStream uses the cache anymore
+    delete m_metaDataCache;
+    m_metaDataCache = 0;
+    delete m_enginePool;
+    m_enginePool = 0;
+    delete m_engineInit;
+    m_engineInit = 0;
 
     s_instance = 0;
     PulseSupport::shutdown();
 }
 
-XineEngine Backend::xineEngineForStream()
+/**
+ * Returns the engine shared by the effects and outputs. The first call may have to wait until
+ * the engine is initialized.
+ */
+// any thread
+XineEngine Backend::xine()
 {
-    XineEngine e;
-    if (s_instance->m_freeEngines.isEmpty()) {
-        e.create();
-    } else {
-        e = s_instance->m_freeEngines.takeLast();
+    Backend *const that = instance();
+    that->m_engineInit->wait();
+    return that->m_xine;
+}
+
+/**
+ * Returns the saved plugin catalog, or the one read from the engine if there was none.
+ */
+// called from main thread
+const PluginCatalog &Backend::pluginCatalog() const
+{
+    if (!m_pluginCatalogValid) {
+        // no way around waiting for xine_init
+        const_cast<Backend *>(this)->engineInitialized();
     }
-    s_instance->m_usedEngines << e;
-    return e;
+    return m_pluginCatalog;
 }
 
-void Backend::returnXineEngine(const XineEngine &e)
+// called from main thread
+void Backend::engineInitialized()
 {
-    s_instance->m_usedEngines.removeAll(e);
-    s_instance->m_freeEngines << e;
-    if (s_instance->m_freeEngines.size() > 5) {
-        s_instance->m_freeEngines.takeLast();
-        s_instance->m_freeEngines.takeLast();
-        s_instance->m_freeEngines.takeLast();
+    if (m_engineInitialized) {
+        return;
+    }
+    m_engineInit->wait();
+    m_engineInitialized = true;
+    const PluginCatalog &catalog = m_engineInit->catalog();
+    if (m_pluginCatalogValid && catalog == m_pluginCatalog) {
+        return;
+    }
+    debug() << Q_FUNC_INFO << "saving the new plugin catalog";
+    catalog.save(cacheFilePath("phonon-xine-plugins"));
+    const bool wasValid = m_pluginCatalogValid;
+    m_pluginCatalog = catalog;
+    m_pluginCatalogValid = true;
+    if (wasValid) {
+        // the saved catalog was out of date, everything derived from it has to be read again
+        m_supportedMimeTypes.clear();
+        m_audioOutputInfos.clear();
+        emit objectDescriptionChanged(AudioOutputDeviceType);
+        emit objectDescriptionChanged(EffectType);
     }
 }
 
+// any thread
+XineEngine Backend::xineEngineForStream()
+{
+    return s_instance->m_enginePool->acquire();
+}
+
+// any thread
+void Backend::returnXineEngine(const XineEngine &e)
+{
+    s_instance->m_enginePool->release(e);
+}
+
+/**
+ * Creates a MediaProbe, which reads the meta data and stream info of many URLs in parallel
+ * without creating a MediaObject for each of them. The caller owns the returned object unless
+ * \p parent is set.
+ */
+QObject *Backend::createMediaProbe(QObject *parent)
+{
+    return new MediaProbe(parent);
+}
+
 QObject *Backend::createObject(BackendInterface::Class c, QObject *parent, const QList<QVariant> &args)
 {
     switch (c) {
@@ -190,11 +346,7 @@ QStringList Backend::availableMimeTypes() const
 {
     if (m_supportedMimeTypes.isEmpty())
     {
-        char *mimeTypes_c = xine_get_mime_types(m_xine);
-        QString mimeTypes(mimeTypes_c);
-        free(mimeTypes_c);
-        QStringList lstMimeTypes = mimeTypes.split(';', QString::SkipEmptyParts);
-        foreach (const QString &mimeType, lstMimeTypes) {
+        foreach (const QString &mimeType, pluginCatalog().mimeTypes) {
             m_supportedMimeTypes << mimeType.left(mimeType.indexOf(':')).trimmed();
         }
         if (m_supportedMimeTypes.contains("application/ogg")) {
@@ -236,8 +388,8 @@ QList<int> Backend::objectDescriptionIndexes(ObjectDescriptionType type) const
         */
     case Phonon::EffectType:
         {
-            const char *const *postPlugins = xine_list_post_plugins_typed(m_xine, XINE_POST_TYPE_AUDIO_FILTER);
-            for (int i = 0; postPlugins[i]; ++i)
+            const int count = pluginCatalog().audioEffectPlugins.size();
+            for (int i = 0; i < count; ++i)
                 list << 0x7F000000 + i;
             /*const char *const *postVPlugins = xine_list_post_plugins_typed(m_xine, XINE_POST_TYPE_VIDEO_FILTER);
             for (int i = 0; postVPlugins[i]; ++i) {
@@ -306,13 +458,11 @@ QHash<QByteArray, QVariant> Backend::objectDescriptionProperties(ObjectDescripti
         */
     case Phonon::EffectType:
         {
-            const char *const *postPlugins = xine_list_post_plugins_typed(m_xine, XINE_POST_TYPE_AUDIO_FILTER);
-            for (int i = 0; postPlugins[i]; ++i) {
-                if (0x7F000000 + i == index) {
-                    ret.insert("name", QLatin1String(postPlugins[i]));
-                    ret.insert("description", QLatin1String(xine_get_post_plugin_description(m_xine, postPlugins[i])));
-                    break;
-                }
+            const QList<PluginCatalog::Plugin> &postPlugins = pluginCatalog().audioEffectPlugins;
+            const int i = index - 0x7F000000;
+            if (i >= 0 && i < postPlugins.size()) {
+                ret.insert("name", QLatin1String(postPlugins[i].name));
+                ret.insert("description", postPlugins[i].description);
             }
             /*const char *const *postVPlugins = xine_list_post_plugins_typed(m_xine, XINE_POST_TYPE_VIDEO_FILTER);
             for (int i = 0; postVPlugins[i]; ++i) {
@@ -413,8 +563,9 @@ bool Backend::endConnectionChange(QSet<QObject *> nodes)
 {
     QList<WireCall> wireCallsUnordered;
     QList<WireCall> wireCalls;
-    QList<QExplicitlySharedDataPointer<SharedData> > allXtObjects;
-    KeepReference<> *keep = new KeepReference<>();
+    // the XT objects are used and have to be released in the thread of the stream of their graph
+    QHash<QThread *, QList<QExplicitlySharedDataPointer<SharedData> > > xtObjects;
+    QHash<QThread *, KeepReference<> *> keeps;
 
     // first we need to find all vertices of the subgraphs formed by the given nodes that are
     // source nodes but don't have a sink node connected and connect them to the NullSink, otherwise
@@ -440,8 +591,7 @@ bool Backend::endConnectionChange(QSet<QObject *> nodes)
     foreach (QObject *q, nodes) {
         SourceNode *source = qobject_cast<SourceNode *>(q);
         if (source) {
-            //keep->addObject(source->threadSafeObject());
-            allXtObjects.append(QExplicitlySharedDataPointer<SharedData>(source->threadSafeObject().data()));
+            xtObjects[source->streamThread()].append(QExplicitlySharedDataPointer<SharedData>(source->threadSafeObject().data()));
             foreach (SinkNode *sink, source->sinks()) {
                 WireCall w(source, sink);
                 if (wireCallsUnordered.contains(w)) {
@@ -454,8 +604,13 @@ bool Backend::endConnectionChange(QSet<QObject *> nodes)
         }
         SinkNode *sink = qobject_cast<SinkNode *>(q);
         if (sink) {
+            QThread *thread = sink->source() ? sink->source()->streamThread() : 0;
+            KeepReference<> *&keep = keeps[thread];
+            if (!keep) {
+                keep = new KeepReference<>(thread);
+            }
             keep->addObject(sink->threadSafeObject().data());
-            allXtObjects.append(QExplicitlySharedDataPointer<SharedData>(sink->threadSafeObject().data()));
+            xtObjects[thread].append(QExplicitlySharedDataPointer<SharedData>(sink->threadSafeObject().data()));
             if (sink->source()) {
                 WireCall w(sink->source(), sink);
                 if (wireCallsUnordered.contains(w)) {
@@ -482,12 +637,14 @@ bool Backend::endConnectionChange(QSet<QObject *> nodes)
         QList<WireCall>::Iterator it = wireCalls.begin();
         const QList<WireCall>::Iterator end = wireCalls.end();
         for (; it != end; ++it) {
-            it->addReferenceTo(allXtObjects);
+            it->addReferenceTo(xtObjects.value(it->thread()));
         }
     }
-    QCoreApplication::postEvent(XineThread::instance(), new RewireEvent(wireCalls, m_disconnections));
+    XineThread::postRewire(wireCalls, m_disconnections);
     m_disconnections.clear();
-    keep->ready();
+    foreach (KeepReference<> *keep, keeps) {
+        keep->ready();
+    }
     return true;
 }
 
@@ -522,6 +679,92 @@ int Backend::deinterlaceMethod()
     return s_instance->m_deinterlaceMethod;
 }
 
+int Backend::byteStreamHistorySize()
+{
+    return s_instance->m_byteStreamHistorySize;
+}
+
+int Backend::byteStreamBufferTime()
+{
+    return s_instance->m_byteStreamBufferTime;
+}
+
+int Backend::xineThreadCount()
+{
+    return s_instance->m_xineThreadCount;
+}
+
+int Backend::openTimeout()
+{
+    return s_instance->m_openTimeout;
+}
+
+int Backend::gaplessPrerollTime()
+{
+    return s_instance->m_gaplessPrerollTime;
+}
+
+int Backend::streamPoolSize()
+{
+    return s_instance->m_streamPoolSize;
+}
+
+qint64 Backend::streamCacheSize()
+{
+    return s_instance->m_streamCacheSize;
+}
+
+QString Backend::streamCacheDirectory()
+{
+    return s_instance->m_streamCacheDirectory;
+}
+
+int Backend::probeThreadCount()
+{
+    if (s_instance->m_probeThreadCount > 0) {
+        return s_instance->m_probeThreadCount;
+    }
+    return qMax(1, QThread::idealThreadCount());
+}
+
+/**
+ * Returns the persistent cache of stream info and meta data, or 0 if it is disabled.
+ */
+MetaDataCache *Backend::metaDataCache()
+{
+    return s_instance->m_metaDataCache;
+}
+
+/**
+ * One line of I/O statistics per ByteStream, for diagnosing applications that play from a
+ * Phonon::AbstractMediaStream.
+ */
+QStringList Backend::byteStreamStatistics() const
+{
+    QStringList ret;
+    foreach (const ByteStream *bs, m_byteStreams) {
+        const ByteStreamStatistics stats = bs->statistics();
+        ret << QString::fromLatin1("%1: queued %2 (peak %3) bytes, blocked %4 ms, %5 underruns, "
+                "seeks: %6 buffered, %7 cached, %8 by the producer, %9 needData, %10 enoughData, "
+                "reads: %11 zero-copy, %12 copied")
+            .arg(reinterpret_cast<quintptr>(bs), 0, 16)
+            .arg(stats.bytesQueued).arg(stats.peakBytesQueued).arg(stats.blockedTime)
+            .arg(stats.underruns).arg(stats.bufferedSeeks).arg(stats.cachedSeeks)
+            .arg(stats.producerSeeks).arg(stats.needDataCalls).arg(stats.enoughDataCalls)
+            .arg(stats.zeroCopyReads).arg(stats.copiedReads);
+    }
+    return ret;
+}
+
+/**
+ * Hits and misses of the pool of free xine engines. Every miss made a new stream wait for a
+ * xine engine to be created.
+ */
+QString Backend::engineStatistics() const
+{
+    return m_enginePool->statistics();
+}
+
 void Backend::setObjectDescriptionProperities(ObjectDescriptionType type, int index, const QHash<QByteArray, QVariant>& properities)
 {
     s_instance->m_objectDescriptions[type][index] = properities;
@@ -616,12 +859,12 @@ void Backend::checkAudioOutputs()
         int nextIndex = 10000;
 
         // This will list the audio drivers, not the actual devices.
-        const char *const *outputPlugins = xine_list_audio_output_plugins(m_xine);
+        const QList<PluginCatalog::Plugin> &outputPlugins = pluginCatalog().audioOutputPlugins;
 
         PulseSupport *pulse = PulseSupport::getInstance();
         if (pulse->isActive()) {
-            for (int i = 0; outputPlugins[i]; ++i) {
-                if (0 == strcmp(outputPlugins[i], "pulseaudio")) {
+            foreach (const PluginCatalog::Plugin &plugin, outputPlugins) {
+                if (plugin.name == "pulseaudio") {
                     // We've detected the pulseaudio output plugin. We're done.
                     return;
                 }
@@ -631,9 +874,10 @@ void Backend::checkAudioOutputs()
             pulse->enable(false);
         }
 
-        for (int i = 0; outputPlugins[i]; ++i) {
-            debug() << Q_FUNC_INFO << "outputPlugin: " << outputPlugins[i];
-            if (0 == strcmp(outputPlugins[i], "alsa")) {
+        foreach (const PluginCatalog::Plugin &plugin, outputPlugins) {
+            const char *const name = plugin.name.constData();
+            debug() << Q_FUNC_INFO << "outputPlugin: " << name;
+            if (0 == strcmp(name, "alsa")) {
                 // we just list "default" for fallback when the platform plugin fails to list
                 // devices
                 addAudioOutput(nextIndex++, 12, tr("ALSA default output"),
@@ -642,8 +886,8 @@ void Backend::checkAudioOutputs()
                             "when the KDE runtime is broken. The technical term 'Platform Plugin' "
                             "might help users to find a solution, so it might make sense to leave "
                             "that term untranslated."),
-                        /*icon name */"audio-card", outputPlugins[i], false, true);
-            } else if (0 == strcmp(outputPlugins[i], "oss")) {
+                        /*icon name */"audio-card", name, false, true);
+            } else if (0 == strcmp(name, "oss")) {
                 // we just list /dev/dsp for fallback when the platform plugin fails to list
                 // devices
                 addAudioOutput(nextIndex++, 11, tr("OSS default output"),
@@ -652,11 +896,11 @@ void Backend::checkAudioOutputs()
                             "when the KDE runtime is broken. The technical term 'Platform Plugin' "
                             "might help users to find a solution, so it might make sense to leave "
                             "that term untranslated."),
-                        /*icon name */"audio-card", outputPlugins[i], false, true);
-            } else if (0 == strcmp(outputPlugins[i], "none")
-                    || 0 == strcmp(outputPlugins[i], "file")) {
+                        /*icon name */"audio-card", name, false, true);
+            } else if (0 == strcmp(name, "none")
+                    || 0 == strcmp(name, "file")) {
                 // ignore these drivers (hardware devices are listed by the KDE platform plugin)
-            } else if (0 == strcmp(outputPlugins[i], "jack")) {
+            } else if (0 == strcmp(name, "jack")) {
                 addAudioOutput(nextIndex++, 9, tr("Jack Audio Connection Kit"),
                         tr("<html><p>JACK is a low-latency audio server. It can connect a number "
                             "of different applications to an audio device, as well as allowing "
@@ -664,22 +908,22 @@ void Backend::checkAudioOutputs()
                             "<p>JACK was designed from the ground up for professional audio "
                             "work, and its design focuses on two key areas: synchronous "
                             "execution of all clients, and low latency operation.</p></html>"),
-                            /*icon name */"audio-backend-jack", outputPlugins[i]);
-            } else if (0 == strcmp(outputPlugins[i], "arts")) {
+                            /*icon name */"audio-backend-jack", name);
+            } else if (0 == strcmp(name, "arts")) {
                 addAudioOutput(nextIndex++, -100, tr("aRts"),
                         tr("<html><p>aRts is the old sound server and media framework that was used "
                             "in KDE2 and KDE3. Its use is discouraged.</p></html>"),
-                        /*icon name */"audio-backend-arts", outputPlugins[i]);
-            } else if (0 == strcmp(outputPlugins[i], "pulseaudio")) {
+                        /*icon name */"audio-backend-arts", name);
+            } else if (0 == strcmp(name, "pulseaudio")) {
                 // Ignore this. We deal with it as a special case above.
-            } else if (0 == strcmp(outputPlugins[i], "esd")) {
+            } else if (0 == strcmp(name, "esd")) {
                 addAudioOutput(nextIndex++, 8, tr("Esound (ESD)"),
-                        xine_get_audio_driver_plugin_description(m_xine, outputPlugins[i]),
-                        /*icon name */"audio-backend-esd", outputPlugins[i]);
+                        plugin.description,
+                        /*icon name */"audio-backend-esd", name);
             } else {
-                addAudioOutput(nextIndex++, -20, outputPlugins[i],
-                        xine_get_audio_driver_plugin_description(m_xine, outputPlugins[i]),
-                        /*icon name */outputPlugins[i], outputPlugins[i]);
+                addAudioOutput(nextIndex++, -20, name,
+                        plugin.description,
+                        /*icon name */name, name);
             }
         }
 
@@ -33,6 +33,7 @@
 #include <xine.h>
 #include <xine/xineutils.h>
 
+#include "plugincatalog.h"
 #include "xineengine.h"
 #include <phonon/objectdescription.h>
 #include <phonon/backendinterface.h>
@@ -59,6 +60,9 @@ class AudioDevice;
 namespace Xine
 {
 
+class ByteStream;
+class MetaDataCache;
+class XineEnginePool;
 class WireCall;
 class XineThread;
 
@@ -76,6 +80,7 @@ class Backend : public QObject, public BackendInterface
         virtual ~Backend();
 
         QObject *createObject(BackendInterface::Class, QObject *parent, const QList<QVariant> &args);
+        Q_INVOKABLE QObject *createMediaProbe(QObject *parent = 0);
 
         QList<int> objectDescriptionIndexes(ObjectDescriptionType) const;
         QHash<QByteArray, QVariant> objectDescriptionProperties(ObjectDescriptionType, int) const;
@@ -88,14 +93,23 @@ class Backend : public QObject, public BackendInterface
         QStringList availableMimeTypes() const;
 
     // phonon-xine internal:
-        static void addCleanupObject(QObject *o) { instance()->m_cleanupObjects << o; }
-        static void removeCleanupObject(QObject *o) { instance()->m_cleanupObjects.removeAll(o); }
-        static const QList<QObject *> &cleanupObjects() { return instance()->m_cleanupObjects; }
+        static void addByteStream(ByteStream *bs) { instance()->m_byteStreams << bs; }
+        static void removeByteStream(ByteStream *bs) { instance()->m_byteStreams.removeAll(bs); }
 
         static bool deinterlaceDVD();
         static bool deinterlaceVCD();
         static bool deinterlaceFile();
         static int deinterlaceMethod();
+        static int byteStreamHistorySize();
+        static int byteStreamBufferTime();
+        static int xineThreadCount();
+        static int openTimeout();
+        static int gaplessPrerollTime();
+        static int streamPoolSize();
+        static int probeThreadCount();
+        static qint64 streamCacheSize();
+        static QString streamCacheDirectory();
+        static MetaDataCache *metaDataCache();
 
         static bool inShutdown() { return instance()->m_inShutdown; }
 
@@ -107,7 +121,7 @@ class Backend : public QObject, public BackendInterface
 
         static QByteArray audioDriverFor(int audioDevice);
 
-        static XineEngine xine() { return instance()->m_xine; }
+        static XineEngine xine();
         static void returnXineEngine(const XineEngine &);
         static XineEngine xineEngineForStream();
 
@@ -115,14 +129,21 @@ class Backend : public QObject, public BackendInterface
         inline QDebug _debug() { if (m_debugMessages) { return qDebug(); } return QDebug(&m_noDebugStream); }
 #endif
 
+    public slots:
+        Q_SCRIPTABLE QStringList byteStreamStatistics() const;
+        Q_SCRIPTABLE QString engineStatistics() const;
+
     signals:
         void objectDescriptionChanged(ObjectDescriptionType);
 
     private slots:
+        void engineInitialized();
         void emitAudioOutputDeviceChange();
         void emitObjectDescriptionChanged(ObjectDescriptionType);
 
     private:
+        class EngineInitThread;
+        const PluginCatalog &pluginCatalog() const;
         void checkAudioOutputs();
         void addAudioOutput(int idx, int initialPreference, const QString &n,
                 const QString &desc, const QString &ic, const QByteArray &dr,
@@ -152,21 +173,34 @@ class Backend : public QObject, public BackendInterface
             inline bool operator<(const AudioOutputInfo &rhs) const { return initialPreference > rhs.initialPreference; }
         };
         QList<AudioOutputInfo> m_audioOutputInfos;
-        QList<QObject *> m_cleanupObjects;
+        // all ByteStreams, only used from the main thread
+        QList<ByteStream *> m_byteStreams;
         int m_deinterlaceMethod : 8;
+        int m_byteStreamHistorySize;
+        int m_byteStreamBufferTime;
+        int m_xineThreadCount;
+        int m_openTimeout;
+        int m_gaplessPrerollTime;
+        int m_streamPoolSize;
+        int m_probeThreadCount;
+        qint64 m_streamCacheSize;
+        QString m_streamCacheDirectory;
+        MetaDataCache *m_metaDataCache;
+        XineEnginePool *m_enginePool;
+        EngineInitThread *m_engineInit;
+        PluginCatalog m_pluginCatalog;
+        bool m_pluginCatalogValid;
+        bool m_engineInitialized;
         bool m_deinterlaceDVD : 1;
         bool m_deinterlaceVCD : 1;
         bool m_deinterlaceFile : 1;
         bool m_inShutdown : 1;
         bool m_debugMessages : 1;
-        XineThread *m_thread;
+        QList<XineThread *> m_threads;
         XineEngine m_xine;
         QTimer signalTimer;
         QList<WireCall> m_disconnections;
 
-        QList<XineEngine> m_usedEngines;
-        QList<XineEngine> m_freeEngines;
-
         friend class XineThread;
 
 #ifndef NDEBUG
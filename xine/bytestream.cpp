@@ -21,10 +21,15 @@
 
 #include "bytestream.h"
 
+#include "backend.h"
 #include "xineengine.h"
 #include "events.h"
+#include "streamcache.h"
+#include "bytestreamtrace.h"
+#include <QDir>
 #include <QEvent>
 #include <QTimer>
+#include <climits>
 #include <cstring>
 #include <cstdio>
 #include <unistd.h>
@@ -87,24 +92,262 @@ ByteStream *ByteStream::fromMrl(const QByteArray &mrl)
 ByteStream::ByteStream(const MediaSource &mediaSource, MediaObject *parent)
     : QObject(0), // don't let MediaObject's ~QObject delete us - the input plugin will delete us
     m_mediaObject(parent),
+    m_cache(0),
+    m_trace(0),
+    m_previewSize(0),
+    m_pendingSize(0),
+    m_writePosition(0),
+    m_seekOffset(0),
+    m_lowWatermark(InitialHighWatermark / 4),
+    m_highWatermark(InitialHighWatermark),
+    m_wantData(1),
     m_streamSize(0),
     m_currentPosition(0),
-    m_buffersize(0),
     m_offset(0),
+    m_rewoundSize(0),
+    m_historySize(0),
+    m_historyLimit(Backend::byteStreamHistorySize()),
+    m_bytesSinceSample(0),
+    m_byteRate(0),
+    m_bufferTime(Backend::byteStreamBufferTime()),
     m_seekable(false),
-    m_stopped(false),
-    m_eod(false),
-    m_buffering(false),
-    m_firstReset(true)
+    m_firstReset(true),
+    m_ringDetached(false),
+    m_seekPending(false)
 {
     connect(this, SIGNAL(resetQueued()), this, SLOT(callStreamInterfaceReset()), Qt::BlockingQueuedConnection);
     connect(this, SIGNAL(needDataQueued()), this, SLOT(needData()), Qt::QueuedConnection);
-    connect(this, SIGNAL(seekStreamQueued(qint64)), this, SLOT(syncSeekStream(qint64)), Qt::QueuedConnection);
+    connect(this, SIGNAL(seekQueued()), this, SLOT(serviceSeek()), Qt::QueuedConnection);
+    connect(this, SIGNAL(flushPendingBuffersQueued()), this, SLOT(flushPendingBuffers()), Qt::QueuedConnection);
+
+    const qint64 cacheSize = parent->streamCacheSize();
+    if (cacheSize > 0) {
+        m_cache = new StreamCache(parent->streamCacheDirectory(), cacheSize);
+        if (!m_cache->isValid()) {
+            delete m_cache;
+            m_cache = 0;
+        }
+    }
+
+    // PHONON_XINE_TRACE_DIR=<dir> records every stream for replaying it with phononxine-replay
+    const QByteArray traceDir = qgetenv("PHONON_XINE_TRACE_DIR");
+    if (!traceDir.isEmpty()) {
+        static QAtomicInt traceCounter;
+        const QString fileName = QString::fromLatin1("bytestream-%1-%2.trace").arg(getpid())
+            .arg(traceCounter.fetchAndAddRelaxed(1));
+        m_trace = new ByteStreamTraceWriter(QDir(QFile::decodeName(traceDir)).filePath(fileName));
+        debug() << Q_FUNC_INFO << "recording the stream to" << fileName;
+    }
 
     connectToSource(mediaSource);
+    m_rateTimer.start();
 
     // created in the main thread
     m_mainThread = pthread_self();
+    Backend::addByteStream(this);
+}
+
+// any thread: wakes the xine thread if it sleeps in waitForData
+void ByteStream::notifyDataWaiters()
+{
+    // ref() is a full barrier: either the sleeping thread sees the new serial before it goes to
+    // sleep or we see it in m_sleepers and wake it up
+    m_dataSerial.ref();
+    if (m_sleepers) {
+        QMutexLocker lock(&m_mutex);
+        m_waitingForData.wakeAll();
+    }
+}
+
+// xine thread: returns false if \p timeout ms passed without a change of \p serial
+bool ByteStream::waitForData(int serial, int timeout)
+{
+    if (m_pendingState == 1 && m_pendingState.testAndSetRelaxed(1, 2)) {
+        // there's data that didn't fit into the ring buffer
+        emit flushPendingBuffersQueued();
+    }
+    QMutexLocker lock(&m_mutex);
+    m_sleepers.ref();
+    bool changed = true;
+    while (m_dataSerial == serial) {
+        if (!m_waitingForData.wait(&m_mutex, timeout < 0 ? ULONG_MAX : timeout)) {
+            changed = (m_dataSerial != serial);
+            break;
+        }
+    }
+    m_sleepers.deref();
+    return changed;
+}
+
+// any thread: asks the StreamInterface for more data, at most one request is queued at a time
+void ByteStream::requestData()
+{
+    m_wantData = 1;
+    if (m_needDataQueued.testAndSetOrdered(0, 1)) {
+        emit needDataQueued();
+    }
+}
+
+void ByteStream::needData()
+{
+    m_needDataQueued = 0;
+    // writeData may have reached the high watermark since the request was queued
+    if (m_wantData) {
+        m_needDataCalls.fetchAndAddRelaxed(1);
+        if (m_trace) {
+            m_trace->record(ByteStreamTraceRecord::NeedData);
+        }
+        StreamInterface::needData();
+    }
+}
+
+// xine thread: adapts the watermarks to the consumption rate \p rate in bytes per second
+void ByteStream::updateWatermarks(qint64 rate)
+{
+    m_byteRate = m_byteRate > 0 ? (3 * m_byteRate + rate) / 4 : rate;
+    const int high = qBound<qint64>(MinHighWatermark, m_byteRate * m_bufferTime / 1000,
+            MaxHighWatermark);
+    if (high != m_highWatermark) {
+        PXINE_VDEBUG << "consuming" << m_byteRate << "bytes/s, new high watermark:" << high;
+        m_highWatermark = high;
+        m_lowWatermark = high / 4;
+    }
+}
+
+// xine thread: measures the consumption rate and asks for more data when the buffered data crosses
+// the low watermark
+void ByteStream::dataConsumed(int len)
+{
+    m_seekPending = false;
+    m_bytesSinceSample += len;
+    const int elapsed = m_rateTimer.elapsed();
+    if (elapsed >= RateSampleInterval) {
+        // a long gap means playback was paused, that doesn't tell anything about the rate
+        if (elapsed < 4 * RateSampleInterval) {
+            updateWatermarks(m_bytesSinceSample * Q_INT64_C(1000) / elapsed);
+        }
+        m_bytesSinceSample = 0;
+        m_rateTimer.restart();
+    }
+    // only the read that drops the buffered data below the low watermark asks for more; while
+    // cached data is read the StreamInterface is only asked again by seekStreamInterface
+    const int buffered = bytesBuffered();
+    if (!m_ringDetached && buffered < m_lowWatermark && buffered + len >= m_lowWatermark) {
+        requestData();
+    }
+}
+
+// xine thread
+void ByteStream::rememberBuffer(const QByteArray &buffer)
+{
+    if (m_historyLimit <= 0) {
+        return;
+    }
+    // keep the most recently read chunks so that short backward seeks don't need the
+    // StreamInterface
+    m_history << buffer;
+    m_historySize += buffer.size();
+    while (m_historySize > m_historyLimit) {
+        m_historySize -= m_history.first().size();
+        m_history.removeFirst();
+    }
+}
+
+// xine thread
+void ByteStream::popBuffer()
+{
+    rememberBuffer(m_buffers.front());
+    m_buffers.pop();
+    m_offset = 0;
+    if (m_pendingState == 1 && m_pendingState.testAndSetRelaxed(1, 2)) {
+        // now there's room in the ring buffer for the data writeData had to put aside
+        emit flushPendingBuffersQueued();
+    }
+}
+
+// xine thread: discards all data that has not been read yet
+void ByteStream::clearBuffers()
+{
+    // with m_writeMutex locked writeData cannot push to m_buffers
+    QMutexLocker lock(&m_writeMutex);
+    discardBuffers();
+}
+
+// xine thread, m_writeMutex must be locked
+void ByteStream::discardBuffers()
+{
+    m_pendingBuffers.clear();
+    m_pendingSize = 0;
+    m_pendingState = 0;
+    while (!m_buffers.isEmpty()) {
+        m_buffers.pop();
+    }
+    m_buffersize = 0;
+    m_offset = 0;
+    m_rewound.clear();
+    m_rewoundSize = 0;
+}
+
+// xine thread: discards the data that was read already
+void ByteStream::clearHistory()
+{
+    m_history.clear();
+    m_historySize = 0;
+}
+
+// xine thread: makes the cached data at \p offset the next data to be read. The data in
+// m_buffers is ignored from now on, as it doesn't continue the cached data.
+bool ByteStream::fillFromCache(qint64 offset)
+{
+    if (!m_cache) {
+        return false;
+    }
+    const QByteArray data = m_cache->read(offset, CacheReadSize);
+    if (data.isEmpty()) {
+        return false;
+    }
+    PXINE_VDEBUG << "read" << data.size() << "bytes at" << offset << "from the cache";
+    clearBuffers();
+    m_rewound << data;
+    m_rewoundSize = data.size();
+    m_ringDetached = true;
+    return true;
+}
+
+// xine thread: throws away the buffers and asks the StreamInterface to continue at \p offset.
+// The xine thread doesn't wait for the seek: it is performed by the thread delivering the data
+// (see serviceSeek) and readFromBuffer only waits for the data at the new position.
+void ByteStream::seekStreamInterface(qint64 offset)
+{
+    {
+        QMutexLocker lock(&m_writeMutex);
+        discardBuffers();
+        m_seekOffset = offset;
+        // from now on writeData drops data until the seek was performed
+        m_seekGeneration.ref();
+        m_eod = false;
+    }
+    m_ringDetached = false;
+    m_seekPending = true;
+    m_seekTimer.start();
+    // if the StreamInterface is not writing right now it needs a push from the main thread
+    emit seekQueued();
+    requestData();
+}
+
+// xine thread: the number of bytes that can be read without waiting
+inline int ByteStream::bytesBuffered()
+{
+    if (m_ringDetached) {
+        return m_rewoundSize;
+    }
+    return m_buffersize.fetchAndAddAcquire(0) + m_rewoundSize;
+}
+
+// xine thread: the chunk m_offset points into
+inline const QByteArray &ByteStream::frontBuffer()
+{
+    return m_rewound.isEmpty() ? m_buffers.front() : m_rewound.first();
 }
 
 void ByteStream::pullBuffer(char *buf, int len)
@@ -116,41 +359,44 @@ void ByteStream::pullBuffer(char *buf, int len)
     //Q_ASSERT(m_mainThread != pthread_self());
 
     PXINE_VDEBUG << len << ", m_offset = " << m_offset << ", m_currentPosition = "
-        << m_currentPosition << ", m_buffersize = " << m_buffersize;
+        << m_currentPosition << ", m_buffersize = " << int(m_buffersize)
+        << ", m_rewoundSize = " << m_rewoundSize;
+    // pullBuffer is only called when there's >= len data available
+    Q_ASSERT(bytesBuffered() >= len);
+    int fromRing = 0;
     while (len > 0) {
-        if (m_buffers.isEmpty()) {
-            // pullBuffer is only called when there's => len data available
-            qFatal("m_currentPosition = %lld, m_preview.size() = %d, len = %d",
-                    m_currentPosition, m_preview.size() ,len);
-        }
-        if (m_buffers.head().size() - m_offset <= len) {
-            // The whole data of the next buffer is needed
-            QByteArray buffer = m_buffers.dequeue();
-            PXINE_VDEBUG << "dequeue one buffer of size " << buffer.size()
-                << ", reading at offset = " << m_offset << ", resetting m_offset to 0";
-            Q_ASSERT(buffer.size() > 0);
-            int tocopy = buffer.size() - m_offset;
-            Q_ASSERT(tocopy > 0);
+        // data that was read before and rewound by seekBuffer comes first
+        const bool rewound = !m_rewound.isEmpty();
+        const QByteArray &buffer = frontBuffer();
+        Q_ASSERT(buffer.size() > m_offset);
+        const int tocopy = qMin(buffer.size() - m_offset, len);
+        if (buf) {
             xine_fast_memcpy(buf, buffer.constData() + m_offset, tocopy);
             buf += tocopy;
-            len -= tocopy;
-            Q_ASSERT(len >= 0);
-            Q_ASSERT(m_buffersize >= static_cast<size_t>(tocopy));
-            m_buffersize -= tocopy;
-            m_offset = 0;
+        }
+        len -= tocopy;
+        m_offset += tocopy;
+        if (rewound) {
+            m_rewoundSize -= tocopy;
         } else {
-            // only a part of the next buffer is needed
-            PXINE_VDEBUG << "read " << len
-                << " bytes from the first buffer at offset = " << m_offset;
-            QByteArray &buffer = m_buffers.head();
-            Q_ASSERT(buffer.size() > 0);
-            xine_fast_memcpy(buf, buffer.constData() + m_offset , len);
-            m_offset += len;
-            Q_ASSERT(m_buffersize >= static_cast<size_t>(len));
-            m_buffersize -= len;
-            len = 0;
+            fromRing += tocopy;
+        }
+        if (m_offset == buffer.size()) {
+            PXINE_VDEBUG << "dequeue one buffer of size " << buffer.size();
+            if (rewound) {
+                rememberBuffer(m_rewound.takeFirst());
+                m_offset = 0;
+            } else {
+                popBuffer();
+            }
         }
     }
+    m_buffersize.fetchAndAddRelaxed(-fromRing);
+}
+
+inline void ByteStream::skipBuffer(int len)
+{
+    pullBuffer(0, len);
 }
 
 int ByteStream::peekBuffer(void *buf)
@@ -162,25 +408,58 @@ int ByteStream::peekBuffer(void *buf)
     // never called from main thread
     //Q_ASSERT(m_mainThread != pthread_self());
 
-    if (m_preview.size() < MAX_PREVIEW_SIZE && !m_eod) {
-        QMutexLocker lock(&m_mutex);
-        // the thread needs to sleep until a wait condition is signalled from writeData
-        while (!m_eod && !m_stopped && m_preview.size() < MAX_PREVIEW_SIZE) {
-            PXINE_VDEBUG << "xine waits for data: " << m_buffersize << ", " << m_eod;
-            emit needDataQueued();
-            m_waitingForData.wait(&m_mutex);
-        }
+    // the thread needs to sleep until writeData filled the preview
+    while (!m_previewReady) {
+        const int serial = m_dataSerial.fetchAndAddAcquire(0);
         if (m_stopped) {
             PXINE_DEBUG << "returning 0, m_stopped = true";
             return 0;
         }
+        if (m_previewReady || m_eod) {
+            break;
+        }
+        PXINE_VDEBUG << "xine waits for data: " << int(m_buffersize) << ", " << int(m_eod);
+        requestData();
+        QTime blockedTimer;
+        blockedTimer.start();
+        waitForData(serial);
+        m_blockedTime.fetchAndAddRelaxed(blockedTimer.elapsed());
     }
 
-    xine_fast_memcpy(buf, m_preview.constData(), m_preview.size());
-    return m_preview.size();
+    // the preview is complete (or the stream ended) so writeData won't touch it anymore, but take
+    // the lock anyway, this is not a hot path
+    QMutexLocker lock(&m_writeMutex);
+    // the only copy of the preview data: straight from the chunks writeData received
+    char *data = static_cast<char *>(buf);
+    int remaining = m_previewSize;
+    foreach (const QByteArray &chunk, m_previewChunks) {
+        const int tocopy = qMin(chunk.size(), remaining);
+        xine_fast_memcpy(data, chunk.constData(), tocopy);
+        data += tocopy;
+        remaining -= tocopy;
+    }
+    if (m_previewReady && m_previewChunks.size() > 1) {
+        // don't keep whole chunks alive just for the preview once the stream is being read
+        m_previewChunks = QList<QByteArray>() << QByteArray(static_cast<char *>(buf), m_previewSize);
+    }
+    return m_previewSize;
 }
 
 qint64 ByteStream::readFromBuffer(void *buf, size_t count)
+{
+    struct iovec vec;
+    vec.iov_base = buf;
+    vec.iov_len = count;
+    return readVector(&vec, 1);
+}
+
+/**
+ * Fills the \p count buffers of \p vec one after the other in one pass over the buffered chunks.
+ * Like readFromBuffer it waits until all buffers are filled, the stream ended or a seek timed out.
+ *
+ * Returns the number of bytes read.
+ */
+qint64 ByteStream::readVector(const struct iovec *vec, int count)
 {
     if (m_stopped) {
         return 0;
@@ -188,49 +467,189 @@ qint64 ByteStream::readFromBuffer(void *buf, size_t count)
     // never called from main thread
     //Q_ASSERT(m_mainThread != pthread_self());
 
-    const qint64 currentPosition = m_currentPosition;
-
-    PXINE_VDEBUG << count;
+    qint64 total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += vec[i].iov_len;
+    }
+    PXINE_VDEBUG << count << total;
+    m_copiedReads.fetchAndAddRelaxed(count);
 
-    QMutexLocker lock(&m_mutex);
-    //debug() << Q_FUNC_INFO << "LOCKED m_mutex: ";
+    int index = 0;
+    char *data = count > 0 ? static_cast<char *>(vec[0].iov_base) : 0;
+    qint64 remainingInVec = count > 0 ? vec[0].iov_len : 0;
+    qint64 remaining = total;
     // get data while more is needed and while we're still receiving data
-    if (m_buffersize < count && !m_eod) {
-        // the thread needs to sleep until a wait condition is signalled from writeData
-        while (!m_eod && !m_stopped && m_buffersize < count) {
-            PXINE_VDEBUG << "xine waits for data: " << m_buffersize << ", " << m_eod;
-            emit needDataQueued();
-            m_waitingForData.wait(&m_mutex);
+    while (remaining > 0) {
+        if (remainingInVec == 0) {
+            ++index;
+            data = static_cast<char *>(vec[index].iov_base);
+            remainingInVec = vec[index].iov_len;
+            continue;
+        }
+        // read the serial before looking at the data, a change afterwards means there's more
+        const int serial = m_dataSerial.fetchAndAddAcquire(0);
+        const int available = bytesBuffered();
+        if (available > 0) {
+            // consume what's there already, this makes room in the ring buffer for more
+            const int len = qMin<qint64>(available, remainingInVec);
+            PXINE_VDEBUG << "calling pullBuffer with m_buffersize = " << available;
+            pullBuffer(data, len);
+            if (m_stopped) {
+                break;
+            }
+            data += len;
+            remainingInVec -= len;
+            remaining -= len;
+            m_currentPosition += len;
+            dataConsumed(len);
+            continue;
         }
         if (m_stopped) {
-            PXINE_DEBUG << "returning 0, m_stopped = true";
-            //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-            return 0;
+            break;
+        }
+        if (m_ringDetached) {
+            // the data from the cache is used up, continue with the cache or the StreamInterface
+            if (!fillFromCache(m_currentPosition)) {
+                seekStreamInterface(m_currentPosition);
+            }
+            continue;
+        }
+        if (m_eod && m_pendingState == 0 && m_buffers.isEmpty()) {
+            // everything that was written has been read
+            if (remaining == total) {
+                PXINE_DEBUG << "return 0, the stream is at its end";
+            } else {
+                PXINE_DEBUG << "returning less data than requested, the stream is at its end";
+            }
+            return total - remaining;
+        }
+        // the thread needs to sleep until writeData signals more data
+        PXINE_VDEBUG << "xine waits for data: " << available << ", " << int(m_eod);
+        requestData();
+        QTime blockedTimer;
+        blockedTimer.start();
+        bool timedOut = false;
+        if (m_seekPending) {
+            // don't wait forever for a StreamInterface that doesn't deliver after a seek
+            const int timeout = SeekTimeout - m_seekTimer.elapsed();
+            timedOut = timeout <= 0 || !waitForData(serial, timeout);
+        } else {
+            m_underruns.fetchAndAddRelaxed(1);
+            waitForData(serial);
+        }
+        m_blockedTime.fetchAndAddRelaxed(blockedTimer.elapsed());
+        if (timedOut) {
+            qWarning() << "no data at" << m_currentPosition << "after seeking";
+            // this read gives up, the following ones wait for the late data like after any other
+            // underrun instead of returning right away
+            m_seekPending = false;
+            return total - remaining;
+        }
+    }
+    if (m_stopped) {
+        PXINE_DEBUG << "returning 0, m_stopped = true";
+        return 0;
+    }
+    return total;
+}
+
+/**
+ * The number of bytes that can be read right now without waiting for the StreamInterface and
+ * without leaving the chunk the read position is in, so that unread() can always take them back.
+ */
+// xine thread
+int ByteStream::chunkBytesAvailable()
+{
+    if (m_stopped || bytesBuffered() == 0) {
+        return 0;
+    }
+    // the rest of the chunk is left, reading it completely would drop the chunk
+    return frontBuffer().size() - m_offset - 1;
+}
+
+/**
+ * Moves the read position \p len bytes back within the current chunk, for data that was read
+ * ahead but not used. Returns false if the data is not in the current chunk anymore.
+ */
+// xine thread
+bool ByteStream::unread(int len)
+{
+    if (m_stopped || len > m_offset) {
+        return false;
+    }
+    rewindBuffer(len);
+    m_currentPosition -= len;
+    return true;
+}
+
+// xine thread: moves the read position \p len bytes back, using m_history if the current chunk
+// doesn't reach back far enough
+void ByteStream::rewindBuffer(int len)
+{
+    Q_ASSERT(len <= m_offset + m_historySize);
+    if (len <= m_offset) {
+        // seek before the current position in the current chunk
+        m_offset -= len;
+        if (m_rewound.isEmpty()) {
+            m_buffersize.fetchAndAddRelaxed(len);
+        } else {
+            m_rewoundSize += len;
         }
-        Q_ASSERT(currentPosition == m_currentPosition);
-        Q_UNUSED(currentPosition);
-        //PXINE_VDEBUG << "m_buffersize = " << m_buffersize;
-    }
-    if (m_buffersize >= count) {
-        PXINE_VDEBUG << "calling pullBuffer with m_buffersize = " << m_buffersize;
-        pullBuffer(static_cast<char *>(buf), count);
-        m_currentPosition += count;
-        //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-        return count;
-    }
-    Q_ASSERT(m_eod);
-    if (m_buffersize > 0) {
-        PXINE_VDEBUG << "calling pullBuffer with m_buffersize = " << m_buffersize;
-        const int len = m_buffersize;
-        pullBuffer(static_cast<char *>(buf), len);
-        m_currentPosition += len;
-        PXINE_DEBUG << "returning less data than requested, the stream is at its end";
-        //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-        return len;
-    }
-    PXINE_DEBUG << "return 0, the stream is at its end";
-    //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-    return 0;
+        return;
+    }
+
+    // go back to the start of the current chunk
+    len -= m_offset;
+    if (m_offset > 0) {
+        if (m_rewound.isEmpty()) {
+            m_buffersize.fetchAndAddRelaxed(m_offset);
+        } else {
+            m_rewoundSize += m_offset;
+        }
+        m_offset = 0;
+    }
+    // and then move chunks from the history to the front until the offset is reached
+    while (len > 0) {
+        const QByteArray buffer = m_history.takeLast();
+        m_historySize -= buffer.size();
+        m_rewound.prepend(buffer);
+        if (buffer.size() >= len) {
+            m_offset = buffer.size() - len;
+            m_rewoundSize += len;
+            len = 0;
+        } else {
+            m_rewoundSize += buffer.size();
+            len -= buffer.size();
+        }
+    }
+}
+
+/**
+ * Reads \p count bytes without copying them, if they are already buffered and stored in one
+ * chunk. \p chunk is set to the chunk holding the data and \p offset to the position of the data
+ * in \p chunk.
+ *
+ * Returns false if the data has to be read with readFromBuffer.
+ */
+bool ByteStream::readChunk(size_t count, QByteArray *chunk, int *offset)
+{
+    if (m_stopped) {
+        return false;
+    }
+    if (bytesBuffered() < static_cast<int>(count)) {
+        return false;
+    }
+    const QByteArray &buffer = frontBuffer();
+    if (buffer.size() - m_offset < static_cast<int>(count)) {
+        return false;
+    }
+    *chunk = buffer;
+    *offset = m_offset;
+    skipBuffer(count);
+    m_currentPosition += count;
+    m_zeroCopyReads.fetchAndAddRelaxed(1);
+    dataConsumed(count);
+    return true;
 }
 
 off_t ByteStream::seekBuffer(qint64 offset)
@@ -253,75 +672,52 @@ off_t ByteStream::seekBuffer(qint64 offset)
     }
 
     // first try to seek in the data we have buffered
-    m_mutex.lock();
-    //debug() << Q_FUNC_INFO << "LOCKED m_mutex: ";
-    if (offset > m_currentPosition && offset < m_currentPosition + m_buffersize) {
+    const int buffersize = bytesBuffered();
+    if (offset > m_currentPosition && offset < m_currentPosition + buffersize) {
         debug() << Q_FUNC_INFO << "seeking behind current position, but inside the buffered data";
         // seek behind the current position in the buffer
-        while (offset > m_currentPosition) {
-            const int gap = offset - m_currentPosition;
-            Q_ASSERT(!m_buffers.isEmpty());
-            const int buffersize = m_buffers.head().size() - m_offset;
-            if (buffersize <= gap) {
-                // discard buffers if they hold data before offset
-                Q_ASSERT(!m_buffers.isEmpty());
-                QByteArray buffer = m_buffers.dequeue();
-                m_buffersize -= buffersize;
-                m_currentPosition += buffersize;
-                m_offset = 0;
-            } else {
-                // offset points to data in the next buffer
-                m_buffersize -= gap;
-                m_currentPosition += gap;
-                m_offset += gap;
-            }
-        }
-        Q_ASSERT(offset == m_currentPosition);
-        //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-        m_mutex.unlock();
+        skipBuffer(offset - m_currentPosition);
+        m_currentPosition = offset;
+        m_bufferedSeeks.fetchAndAddRelaxed(1);
         return m_currentPosition;
-    } else if (offset < m_currentPosition && m_currentPosition - offset <= m_offset) {
-        debug() << Q_FUNC_INFO << "seeking in current buffer: m_currentPosition = " << m_currentPosition << ", m_offset = " << m_offset;
-        // seek before the current position in the buffer
-        m_offset -= m_currentPosition - offset;
-        m_buffersize += m_currentPosition - offset;
-        Q_ASSERT(m_offset >= 0);
+    } else if (offset < m_currentPosition && m_currentPosition - offset <= m_offset + m_historySize) {
+        debug() << Q_FUNC_INFO << "seeking back into data that was read already: m_currentPosition = "
+            << m_currentPosition << ", m_offset = " << m_offset << ", m_historySize = " << m_historySize;
+        rewindBuffer(m_currentPosition - offset);
         m_currentPosition = offset;
-        //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-        m_mutex.unlock();
+        m_bufferedSeeks.fetchAndAddRelaxed(1);
         return m_currentPosition;
     }
 
     // the ByteStream is not seekable: no chance to seek to the requested offset
     if (!m_seekable) {
-        //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-        m_mutex.unlock();
+        return m_currentPosition;
+    }
+
+    // data that was seen before can be read from the cache
+    if (m_cache && fillFromCache(offset)) {
+        debug() << Q_FUNC_INFO << "seeking to cached data at" << offset;
+        clearHistory();
+        m_currentPosition = offset;
+        m_cachedSeeks.fetchAndAddRelaxed(1);
         return m_currentPosition;
     }
 
     PXINE_DEBUG << "seeking to a position that's not in the buffered data: clear the buffer. "
         " new offset = " << offset <<
-        ", m_buffersize = " << m_buffersize <<
+        ", m_buffersize = " << buffersize <<
         ", m_offset = " << m_offset <<
-        ", m_eod = " << m_eod <<
+        ", m_eod = " << int(m_eod) <<
         ", m_currentPosition = " << m_currentPosition;
 
     // throw away the buffers and ask for new data
-    m_buffers.clear();
-    m_buffersize = 0;
-    m_offset = 0;
-    m_eod = false;
-
+    m_producerSeeks.fetchAndAddRelaxed(1);
+    clearHistory();
     m_currentPosition = offset;
-    //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
-    m_mutex.unlock();
-
-    QMutexLocker seekLock(&m_seekMutex);
+    seekStreamInterface(offset);
     if (m_stopped) {
         return 0;
     }
-    emit seekStreamQueued(offset); //calls syncSeekStream from the main thread
-    m_seekWaitCondition.wait(&m_seekMutex); // waits until the seekStream signal returns
     return offset;
 }
 
@@ -334,6 +730,27 @@ ByteStream::~ByteStream()
 {
     Q_ASSERT(m_mainThread == pthread_self());
     PXINE_DEBUG;
+    Backend::removeByteStream(this);
+    delete m_cache;
+    delete m_trace;
+}
+
+// any thread
+ByteStreamStatistics ByteStream::statistics() const
+{
+    ByteStreamStatistics stats;
+    stats.bytesQueued = m_buffersize + m_pendingSize;
+    stats.peakBytesQueued = m_peakQueued;
+    stats.blockedTime = m_blockedTime;
+    stats.underruns = m_underruns;
+    stats.bufferedSeeks = m_bufferedSeeks;
+    stats.cachedSeeks = m_cachedSeeks;
+    stats.producerSeeks = m_producerSeeks;
+    stats.needDataCalls = m_needDataCalls;
+    stats.enoughDataCalls = m_enoughDataCalls;
+    stats.zeroCopyReads = m_zeroCopyReads;
+    stats.copiedReads = m_copiedReads;
+    return stats;
 }
 
 QByteArray ByteStream::mrl() const
@@ -372,10 +789,13 @@ QByteArray ByteStream::mrl() const
 void ByteStream::setStreamSize(qint64 x)
 {
     PXINE_VDEBUG << x;
+    if (m_trace) {
+        m_trace->record(ByteStreamTraceRecord::StreamSize, x);
+    }
     QMutexLocker lock(&m_streamSizeMutex);
     m_streamSize = x;
     if (m_streamSize != 0) {
-        emit needDataQueued();
+        requestData();
         m_waitForStreamSize.wakeAll();
     }
 }
@@ -385,6 +805,8 @@ void ByteStream::setPauseForBuffering(bool b)
     if (b) {
         QCoreApplication::postEvent(m_mediaObject->stream().data(), new QEVENT(PauseForBuffering));
         m_buffering = true;
+        // the network buffer control wants its fifos filled, regardless of the watermarks
+        requestData();
     } else {
         QCoreApplication::postEvent(m_mediaObject->stream().data(), new QEVENT(UnpauseForBuffering));
         m_buffering = false;
@@ -394,18 +816,22 @@ void ByteStream::setPauseForBuffering(bool b)
 void ByteStream::endOfData()
 {
     PXINE_DEBUG;
+    if (m_trace) {
+        m_trace->record(ByteStreamTraceRecord::EndOfData);
+    }
 
-    m_mutex.lock();
-    m_seekMutex.lock();
     m_streamSizeMutex.lock();
-    m_eod = true;
+    {
+        QMutexLocker lock(&m_writeMutex);
+        // if xine seeked meanwhile the end of the data at the old position doesn't matter
+        if (m_writeGeneration == m_seekGeneration) {
+            m_eod = true;
+        }
+    }
     // don't reset the XineStream because many demuxers hit eod while trying to find the format of
     // the data
     // stream().setMrl(mrl());
-    m_seekWaitCondition.wakeAll();
-    m_seekMutex.unlock();
-    m_waitingForData.wakeAll();
-    m_mutex.unlock();
+    notifyDataWaiters();
     m_waitForStreamSize.wakeAll();
     m_streamSizeMutex.unlock();
 }
@@ -413,6 +839,9 @@ void ByteStream::endOfData()
 void ByteStream::setStreamSeekable(bool seekable)
 {
     m_seekable = seekable;
+    if (m_trace) {
+        m_trace->record(ByteStreamTraceRecord::Seekable, seekable);
+    }
 }
 
 void ByteStream::writeData(const QByteArray &data)
@@ -421,51 +850,135 @@ void ByteStream::writeData(const QByteArray &data)
         return;
     }
 
-    // first fill the preview buffer
-    if (m_preview.size() != MAX_PREVIEW_SIZE) {
-        PXINE_DEBUG << "fill preview";
-        // more data than the preview buffer needs
-        if (m_preview.size() + data.size() > MAX_PREVIEW_SIZE) {
-            int tocopy = MAX_PREVIEW_SIZE - m_preview.size();
-            m_preview += data.left(tocopy);
-        } else { // all data fits into the preview buffer
-            m_preview += data;
+    PXINE_VDEBUG << data.size() << " m_streamSize = " << m_streamSize;
+
+    if (m_writeGeneration != m_seekGeneration) {
+        // xine seeked, this data is still from the old position
+        serviceSeek();
+        return;
+    }
+
+    int queued;
+    int pending;
+    {
+        QMutexLocker lock(&m_writeMutex);
+        if (m_writeGeneration != m_seekGeneration) {
+            // a seek was requested just now
+            return;
+        }
+        if (m_trace) {
+            m_trace->recordData(data);
+        }
+        // first fill the preview buffer
+        if (!m_previewReady) {
+            PXINE_DEBUG << "fill preview";
+            // more data than the preview buffer needs
+            // only keep a reference to the chunk, peekBuffer copies the data if xine asks for it
+            m_previewChunks << data;
+            m_previewSize = qMin(m_previewSize + data.size(), static_cast<int>(MAX_PREVIEW_SIZE));
+            if (m_previewSize == MAX_PREVIEW_SIZE) {
+                m_previewReady = true;
+            }
+
+            PXINE_VDEBUG << "filled preview buffer to " << m_previewSize;
+        }
+
+        if (m_cache) {
+            m_cache->write(m_writePosition, data);
         }
+        m_writePosition += data.size();
 
-        PXINE_VDEBUG << "filled preview buffer to " << m_preview.size();
+        if (m_ringDetached) {
+            // the xine thread reads cached data and discards m_buffers before it asks the
+            // StreamInterface again (seekStreamInterface), so queuing the data would only pile
+            // it up in m_pendingBuffers
+        } else if (m_pendingBuffers.isEmpty() && m_buffers.push(data)) {
+            // keep the order: older data that didn't fit into the ring buffer goes first
+            m_buffersize.fetchAndAddOrdered(data.size());
+        } else {
+            m_pendingBuffers << data;
+            m_pendingSize.fetchAndAddRelaxed(data.size());
+            pushPendingBuffers();
+        }
+        pending = m_pendingSize;
+        queued = m_buffersize + pending;
+        // only writeData stores to m_peakQueued
+        if (queued > m_peakQueued) {
+            m_peakQueued = queued;
+        }
+        PXINE_VDEBUG << "m_buffersize = " << int(m_buffersize);
     }
+    notifyDataWaiters();
 
-    PXINE_VDEBUG << data.size() << " m_streamSize = " << m_streamSize;
+    // While the preview is not ready or xine's network buffer control is buffering more data is
+    // always wanted. Otherwise stop the StreamInterface only when the high watermark is reached;
+    // it is asked again when the xine thread reads the data down to the low watermark
+    // (dataConsumed). Reading from the cache or too much data that doesn't fit into the ring
+    // stops it in any case.
+    if ((queued >= m_highWatermark && m_previewReady && !m_buffering) || m_ringDetached ||
+            pending >= MaxPendingSize) {
+        if (m_wantData.testAndSetOrdered(1, 0)) {
+            m_enoughDataCalls.fetchAndAddRelaxed(1);
+            if (m_trace) {
+                m_trace->record(ByteStreamTraceRecord::EnoughData);
+            }
+            enoughData();
+        }
+    }
+}
 
-    QMutexLocker lock(&m_mutex);
-    //debug() << Q_FUNC_INFO << "LOCKED m_mutex: ";
-    m_buffers.enqueue(data);
-    m_buffersize += data.size();
-    PXINE_VDEBUG << "m_buffersize = " << m_buffersize;
-    // FIXME accessing m_mediaObject is not threadsafe
-    switch (m_mediaObject->state()) {
-    case Phonon::BufferingState: // if nbc is buffering we want more data
-    case Phonon::LoadingState: // if the preview is not ready we want me more data
-        break;
-    default:
-        enoughData(); // else it's enough
-    }
-    m_waitingForData.wakeAll();
-    //debug() << Q_FUNC_INFO << "UNLOCKING m_mutex: ";
+// m_writeMutex must be locked
+void ByteStream::pushPendingBuffers()
+{
+    while (!m_pendingBuffers.isEmpty() && m_buffers.push(m_pendingBuffers.first())) {
+        const int size = m_pendingBuffers.first().size();
+        m_buffersize.fetchAndAddOrdered(size);
+        m_pendingSize.fetchAndAddRelaxed(-size);
+        m_pendingBuffers.removeFirst();
+    }
+    // the xine thread requests flushPendingBuffers when it made room in the ring buffer
+    m_pendingState = m_pendingBuffers.isEmpty() ? 0 : 1;
+}
+
+void ByteStream::flushPendingBuffers()
+{
+    {
+        QMutexLocker lock(&m_writeMutex);
+        pushPendingBuffers();
+    }
+    notifyDataWaiters();
 }
 
 void ByteStream::callStreamInterfaceReset()
 {
+    if (m_trace) {
+        m_trace->record(ByteStreamTraceRecord::Reset);
+    }
     StreamInterface::reset();
 }
 
-void ByteStream::syncSeekStream(qint64 offset)
+// called from the thread delivering the data or from the main thread: performs the seek the xine
+// thread requested in seekStreamInterface
+void ByteStream::serviceSeek()
 {
-    PXINE_VDEBUG;
-    m_seekMutex.lock();
+    qint64 offset;
+    {
+        QMutexLocker lock(&m_writeMutex);
+        if (m_writeGeneration == m_seekGeneration) {
+            // no seek pending (anymore)
+            return;
+        }
+        offset = m_seekOffset;
+        m_writePosition = offset;
+        // everything that is written from now on is data at the new position, even if it's
+        // written from within seekStream
+        m_writeGeneration = int(m_seekGeneration);
+    }
+    PXINE_VDEBUG << offset;
+    if (m_trace) {
+        m_trace->record(ByteStreamTraceRecord::Seek, offset);
+    }
     seekStream(offset);
-    m_seekWaitCondition.wakeAll();
-    m_seekMutex.unlock();
 }
 
 qint64 ByteStream::streamSize() const
@@ -484,16 +997,10 @@ void ByteStream::stop()
 {
     PXINE_VDEBUG;
 
-    m_mutex.lock();
-    m_seekMutex.lock();
     m_streamSizeMutex.lock();
     m_stopped = true;
-    // the other thread is now not between m_mutex.lock() and m_waitingForData.wait(&m_mutex), so it
-    // won't get stuck in m_waitingForData.wait if it's not there right now
-    m_seekWaitCondition.wakeAll();
-    m_seekMutex.unlock();
-    m_waitingForData.wakeAll();
-    m_mutex.unlock();
+    // wakes the xine thread if it waits for data, also after a seek
+    notifyDataWaiters();
     m_waitForStreamSize.wakeAll();
     m_streamSizeMutex.unlock();
 }
@@ -505,15 +1012,26 @@ void ByteStream::reset()
         m_firstReset = false;
         return;
     }
-    emit resetQueued();
+    // the StreamInterface may already write new data from reset(), so everything has to be
+    // cleared before
+    clearBuffers();
+    clearHistory();
+    m_writeMutex.lock();
+    m_writePosition = 0;
+    // a seek that has not been performed yet is obsolete
+    m_writeGeneration = int(m_seekGeneration);
+    m_writeMutex.unlock();
+    m_ringDetached = false;
+    m_seekPending = false;
     m_currentPosition = 0;
-    m_buffersize = 0;
-    m_offset = 0;
     m_stopped = false;
     m_eod = false;
     m_buffering = false;
+    m_bytesSinceSample = 0;
+    m_rateTimer.restart();
+    emit resetQueued();
     if (m_streamSize != 0) {
-        emit needDataQueued();
+        requestData();
     }
 }
 
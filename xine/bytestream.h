@@ -26,16 +26,21 @@
 #include <xine.h>
 
 #include "xineengine.h"
+#include "spscringbuffer.h"
 #include <phonon/StreamInterface>
+#include <QAtomicInt>
 #include <QByteArray>
 #include <QSharedData>
-#include <QQueue>
+#include <QList>
 #include <QCoreApplication>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTime>
 #include <pthread.h>
+#include <sys/uio.h>
 #include <cstdlib>
 #include <QObject>
+#include "bytestreamstatistics.h"
 
 extern const char Error__off_t_needs_to_have_64_bits[sizeof(off_t) == 8 ? 1 : -1];
 
@@ -44,6 +49,8 @@ namespace Phonon
 namespace Xine
 {
 class MediaObject;
+class StreamCache;
+class ByteStreamTraceWriter;
 class ByteStream : public QObject, public StreamInterface, public QSharedData
 {
     Q_OBJECT
@@ -75,44 +82,168 @@ class ByteStream : public QObject, public StreamInterface, public QSharedData
         // for the xine input plugin:
         int peekBuffer(void *buf);
         qint64 readFromBuffer(void *buf, size_t count);
+        qint64 readVector(const struct iovec *vec, int count);
+        int chunkBytesAvailable();
+        bool unread(int len);
+
+        ByteStreamStatistics statistics() const;
+        bool readChunk(size_t count, QByteArray *chunk, int *offset);
         off_t seekBuffer(qint64 offset);
         off_t currentPosition() const;
 
     signals:
         void resetQueued();
         void needDataQueued();
-        void seekStreamQueued(qint64);
+        void seekQueued();
+        void flushPendingBuffersQueued();
 
     private slots:
         void callStreamInterfaceReset();
-        void syncSeekStream(qint64 offset);
-        void needData() { StreamInterface::needData(); }
+        void serviceSeek();
+        void needData();
+        void flushPendingBuffers();
 
     private:
 //X             void setMrl();
         void pullBuffer(char *buf, int len);
+        void skipBuffer(int len);
+        void popBuffer();
+        void rememberBuffer(const QByteArray &buffer);
+        void rewindBuffer(int len);
+        int bytesBuffered();
+        const QByteArray &frontBuffer();
+        void clearBuffers();
+        void discardBuffers();
+        void clearHistory();
+        bool fillFromCache(qint64 offset);
+        void seekStreamInterface(qint64 offset);
+        void pushPendingBuffers();
+        void notifyDataWaiters();
+        bool waitForData(int serial, int timeout = -1);
+        void requestData();
+        void dataConsumed(int len);
+        void updateWatermarks(qint64 rate);
+
+        enum {
+            // number of chunks the ring holds before writeData has to fall back to
+            // m_pendingBuffers
+            RingSize = 512,
+            // writeData stops the StreamInterface when m_pendingBuffers grows beyond this, even
+            // while buffering
+            MaxPendingSize = 8 * 1024 * 1024,
+            // how much data is read from the cache at once
+            CacheReadSize = 256 * 1024,
+            // bounds for the high watermark, the low watermark is a quarter of it
+            MinHighWatermark = 256 * 1024,
+            MaxHighWatermark = 32 * 1024 * 1024,
+            InitialHighWatermark = 1024 * 1024,
+            // how often (in ms) the consumption rate is sampled
+            RateSampleInterval = 250,
+            // how long (in ms) readFromBuffer waits for data after a seek
+            SeekTimeout = 10000
+        };
 
         MediaObject *m_mediaObject;
-        QByteArray m_preview;
+        StreamCache *m_cache;
+        ByteStreamTraceWriter *m_trace;
+        // the chunks the first MAX_PREVIEW_SIZE bytes of the stream are in
+        QList<QByteArray> m_previewChunks;
+        int m_previewSize;
+
+        // Protects the producer side: the preview, m_pendingBuffers and pushing to m_buffers. It is
+        // never taken by the xine thread while reading, only when resetting.
+        QMutex m_writeMutex;
+        // Only locked when the xine thread has to sleep or to wake it up.
         QMutex m_mutex;
-        QMutex m_seekMutex;
         mutable QMutex m_streamSizeMutex;
         mutable QWaitCondition m_waitForStreamSize;
         QWaitCondition m_waitingForData;
-        QWaitCondition m_seekWaitCondition;
-        QQueue<QByteArray> m_buffers;
+
+        // written by writeData, read by the xine thread
+        SpscRingBuffer<QByteArray, RingSize> m_buffers;
+        // chunks that did not fit into m_buffers, only touched with m_writeMutex locked
+        QList<QByteArray> m_pendingBuffers;
+        // number of bytes in m_pendingBuffers, only changed with m_writeMutex locked, atomic for
+        // statistics()
+        QAtomicInt m_pendingSize;
+        // stream position of the next byte writeData receives, only touched with m_writeMutex
+        // locked
+        qint64 m_writePosition;
+
+        // Seek channel: the xine thread stores the offset and increments m_seekGeneration (with
+        // m_writeMutex locked), the producer side performs the seek and sets m_writeGeneration to
+        // the generation it serviced. Data written while they differ is from the old position.
+        qint64 m_seekOffset;
+        QAtomicInt m_seekGeneration;
+        QAtomicInt m_writeGeneration;
+        // number of bytes in m_buffers that the xine thread has not read yet
+        QAtomicInt m_buffersize;
+        // incremented whenever new data, eod or stop is signalled; the xine thread sleeps until it
+        // changes
+        QAtomicInt m_dataSerial;
+        // number of threads sleeping in waitForData
+        QAtomicInt m_sleepers;
+        // 0: nothing pending, 1: m_pendingBuffers has data, 2: flush has been requested
+        QAtomicInt m_pendingState;
+        QAtomicInt m_previewReady;
+        QAtomicInt m_stopped;
+        QAtomicInt m_eod;
+        // set while xine's network buffer control paused playback to fill its fifos
+        QAtomicInt m_buffering;
+        // set by the xine thread while m_rewound holds data from the cache and m_buffers has to be
+        // ignored; writeData then only writes to the cache
+        QAtomicInt m_ringDetached;
+
+        // Flow control: writeData calls enoughData() once the buffered data reaches the high
+        // watermark, the xine thread asks for data again when it drops below the low watermark.
+        // Both marks are set by the xine thread from the measured consumption rate.
+        QAtomicInt m_lowWatermark;
+        QAtomicInt m_highWatermark;
+        // 1 while the StreamInterface should deliver data, 0 after enoughData()
+        QAtomicInt m_wantData;
+        // 1 while a needDataQueued signal has not been delivered yet
+        QAtomicInt m_needDataQueued;
+
+        // statistics, only updated with relaxed atomics
+        QAtomicInt m_peakQueued;
+        QAtomicInt m_blockedTime;
+        QAtomicInt m_underruns;
+        QAtomicInt m_bufferedSeeks;
+        QAtomicInt m_cachedSeeks;
+        QAtomicInt m_producerSeeks;
+        QAtomicInt m_needDataCalls;
+        QAtomicInt m_enoughDataCalls;
+        QAtomicInt m_zeroCopyReads;
+        QAtomicInt m_copiedReads;
 
         pthread_t m_mainThread;
         qint64 m_streamSize;
         qint64 m_currentPosition;
-        size_t m_buffersize;
+        // The following members are only used by the xine thread:
+        // chunks that were read already and are read again after a backward seek, they come
+        // before m_buffers
+        QList<QByteArray> m_rewound;
+        // the most recently read chunks, oldest first, for serving backward seeks
+        QList<QByteArray> m_history;
+        // read offset into m_rewound.first() or, if m_rewound is empty, into m_buffers.front()
         int m_offset;
+        // number of bytes in m_rewound that have not been read (again)
+        int m_rewoundSize;
+        int m_historySize;
+        const int m_historyLimit;
+        // consumption rate measurement
+        QTime m_rateTimer;
+        int m_bytesSinceSample;
+        qint64 m_byteRate;
+        // how many milliseconds of data should be buffered at the high watermark
+        const int m_bufferTime;
+        // started when a seek is requested, for the SeekTimeout
+        QTime m_seekTimer;
 
         bool m_seekable : 1;
-        bool m_stopped : 1;
-        bool m_eod : 1;
-        bool m_buffering : 1;
         bool m_firstReset : 1;
+        // xine thread: no data has been read since the last seek of the StreamInterface
+        bool m_seekPending;
 };
 }} //namespace Phonon::Xine
 
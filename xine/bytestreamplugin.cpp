@@ -18,6 +18,10 @@
 */
 
 #include <QExplicitlySharedDataPointer>
+#include <QList>
+
+#include <new>
+#include <sys/uio.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -51,18 +55,32 @@ public:
 
     inline Phonon::Xine::ByteStream *bytestream() { return m_bytestream.data(); }
 
+    // the position xine sees, without the data that was read ahead
+    inline off_t currentPosition() { return m_bytestream->currentPosition() - m_readAheadSize; }
+
+    void setReadAhead(fifo_buffer_t *fifo, buf_element_t **bufs, int count);
+    buf_element_t *takeReadAhead(fifo_buffer_t *fifo, off_t todo);
+    void dropReadAhead();
+    void clearReadAhead();
+
 private:
     xine_stream_t *m_stream;
     nbc_t *m_nbc;
     const QByteArray m_mrl;
     MySharedDataPointer<Phonon::Xine::ByteStream> m_bytestream;
+    // buffers of equal size that read_block filled ahead from m_readAheadFifo, in stream order
+    QList<buf_element_t *> m_readAhead;
+    fifo_buffer_t *m_readAheadFifo;
+    off_t m_readAheadSize;
 };
 
 KByteStreamInputPlugin::KByteStreamInputPlugin(xine_stream_t *stream, const char *_mrl)
     : m_stream(stream),
     m_nbc(nbc_init(stream)),
     m_mrl(_mrl),
-    m_bytestream(Phonon::Xine::ByteStream::fromMrl(m_mrl))
+    m_bytestream(Phonon::Xine::ByteStream::fromMrl(m_mrl)),
+    m_readAheadFifo(0),
+    m_readAheadSize(0)
 {
     if (!m_bytestream) {
         return;
@@ -79,6 +97,7 @@ KByteStreamInputPlugin::KByteStreamInputPlugin(xine_stream_t *stream, const char
 
 KByteStreamInputPlugin::~KByteStreamInputPlugin()
 {
+    clearReadAhead();
     if (m_nbc) {
         nbc_close(m_nbc);
     }
@@ -87,6 +106,51 @@ KByteStreamInputPlugin::~KByteStreamInputPlugin()
     }
 }
 
+void KByteStreamInputPlugin::setReadAhead(fifo_buffer_t *fifo, buf_element_t **bufs, int count)
+{
+    Q_ASSERT(m_readAhead.isEmpty());
+    m_readAheadFifo = fifo;
+    for (int i = 0; i < count; ++i) {
+        m_readAhead << bufs[i];
+        m_readAheadSize += bufs[i]->size;
+    }
+}
+
+// returns the next buffer that was read ahead if it fits the request, else gives them all back
+buf_element_t *KByteStreamInputPlugin::takeReadAhead(fifo_buffer_t *fifo, off_t todo)
+{
+    if (m_readAhead.isEmpty()) {
+        return NULL;
+    }
+    if (fifo != m_readAheadFifo || m_readAhead.first()->size != todo) {
+        dropReadAhead();
+        return NULL;
+    }
+    buf_element_t *buf = m_readAhead.takeFirst();
+    m_readAheadSize -= buf->size;
+    return buf;
+}
+
+// frees the buffers that were read ahead and moves the ByteStream back to where xine is
+void KByteStreamInputPlugin::dropReadAhead()
+{
+    const off_t size = m_readAheadSize;
+    clearReadAhead();
+    if (size > 0 && !m_bytestream->unread(size)) {
+        m_bytestream->seekBuffer(m_bytestream->currentPosition() - size);
+    }
+}
+
+// frees the buffers that were read ahead without touching the ByteStream
+void KByteStreamInputPlugin::clearReadAhead()
+{
+    foreach (buf_element_t *buf, m_readAhead) {
+        buf->free_buffer(buf);
+    }
+    m_readAhead.clear();
+    m_readAheadSize = 0;
+}
+
 static uint32_t kbytestream_plugin_get_capabilities (input_plugin_t *this_gen)
 {
     KByteStreamInputPlugin *that = static_cast<KByteStreamInputPlugin *>(this_gen);
@@ -101,34 +165,140 @@ static off_t kbytestream_plugin_read (input_plugin_t *this_gen, char *buf, off_t
 #endif
 {
     KByteStreamInputPlugin *that = static_cast<KByteStreamInputPlugin *>(this_gen);
+    that->dropReadAhead();
     off_t read = that->bytestream()->readFromBuffer(buf, len);
     return read;
 }
 
+// reading blocks smaller than this isn't worth the bookkeeping for handing out the QByteArray
+static const off_t KBYTESTREAM_MIN_ZERO_COPY_SIZE = 8192;
+// how many buffers of smaller blocks read_block fills with one read
+static const int KBYTESTREAM_MAX_READ_AHEAD = 8;
+
+/*
+ * Lives in the pool memory of the buf_element_t while the buffer points into a QByteArray. That
+ * memory is unused until the buffer is freed, so no allocation and no lookup table is needed:
+ * buf->source points to it and it remembers everything to hand the buffer back to its pool.
+ */
+struct KByteStreamZeroCopyBuffer
+{
+    QByteArray chunk;
+    unsigned char *mem;
+    int32_t max_size;
+    void (*free_buffer)(buf_element_t *);
+    void *source;
+};
+
+// any thread: called by whoever releases the buffer
+static void kbytestream_free_zero_copy_buffer(buf_element_t *buf)
+{
+    KByteStreamZeroCopyBuffer *zeroCopy = static_cast<KByteStreamZeroCopyBuffer *>(buf->source);
+    Q_ASSERT(zeroCopy->free_buffer);
+    // give the buffer its own memory back before it returns to the pool
+    buf->mem = zeroCopy->mem;
+    buf->content = buf->mem;
+    buf->max_size = zeroCopy->max_size;
+    buf->free_buffer = zeroCopy->free_buffer;
+    buf->source = zeroCopy->source;
+    // drops the reference to the QByteArray data
+    zeroCopy->~KByteStreamZeroCopyBuffer();
+    buf->free_buffer(buf);
+}
+
+// takes over \p chunk, the caller's reference is cleared
+static void kbytestream_attach_chunk(buf_element_t *buf, QByteArray *chunk, int offset, int size)
+{
+    Q_ASSERT(buf->max_size >= static_cast<int32_t>(sizeof(KByteStreamZeroCopyBuffer)));
+    KByteStreamZeroCopyBuffer *zeroCopy = new (buf->mem) KByteStreamZeroCopyBuffer;
+    zeroCopy->chunk = *chunk;
+    chunk->clear();
+    zeroCopy->mem = buf->mem;
+    zeroCopy->max_size = buf->max_size;
+    zeroCopy->free_buffer = buf->free_buffer;
+    zeroCopy->source = buf->source;
+    // The ByteStream keeps referencing the chunk (ring, history, preview), constData() doesn't
+    // detach it. Neither the ByteStream nor the demuxers and decoders write to a
+    // BUF_DEMUX_BLOCK buffer, so all of them can read the same data.
+    buf->mem = reinterpret_cast<unsigned char *>(const_cast<char *>(zeroCopy->chunk.constData())) + offset;
+    buf->content = buf->mem;
+    buf->size = size;
+    buf->max_size = size;
+    buf->free_buffer = kbytestream_free_zero_copy_buffer;
+    buf->source = zeroCopy;
+}
+
 static buf_element_t *kbytestream_plugin_read_block (input_plugin_t *this_gen, fifo_buffer_t *fifo, off_t todo)
 {
     KByteStreamInputPlugin *that = static_cast<KByteStreamInputPlugin *>(this_gen);
-    buf_element_t *buf = fifo->buffer_pool_alloc(fifo);
+    buf_element_t *buf = that->takeReadAhead(fifo, todo);
+    if (buf) {
+        return buf;
+    }
+    buf = fifo->buffer_pool_alloc(fifo);
 
-    buf->content = buf->mem;
     buf->type = BUF_DEMUX_BLOCK;
-    buf->size = 0;
 
-    while (buf->size < todo) {
-        const off_t num_bytes = that->bytestream()->readFromBuffer(buf->mem + buf->size, todo - buf->size);
-        if (num_bytes <= 0) {
-            buf->free_buffer(buf);
-            return NULL;
+    if (todo >= KBYTESTREAM_MIN_ZERO_COPY_SIZE &&
+            buf->max_size >= static_cast<int32_t>(sizeof(KByteStreamZeroCopyBuffer))) {
+        QByteArray chunk;
+        int offset;
+        if (that->bytestream()->readChunk(todo, &chunk, &offset)) {
+            kbytestream_attach_chunk(buf, &chunk, offset, todo);
+            return buf;
         }
-        buf->size += num_bytes;
     }
 
+    buf->content = buf->mem;
+
+    if (todo < KBYTESTREAM_MIN_ZERO_COPY_SIZE) {
+        // Small blocks are requested at a high rate: fill the following blocks from the current
+        // chunk with the same read, the next calls take them from the read ahead buffers. Only
+        // free pool buffers are taken, the decoders must not wait for the read ahead.
+        const int blocks = qMin<off_t>(KBYTESTREAM_MAX_READ_AHEAD,
+                that->bytestream()->chunkBytesAvailable() / todo);
+        if (blocks > 1) {
+            buf_element_t *bufs[KBYTESTREAM_MAX_READ_AHEAD];
+            struct iovec vec[KBYTESTREAM_MAX_READ_AHEAD];
+            bufs[0] = buf;
+            int count = 1;
+            while (count < blocks && (bufs[count] = fifo->buffer_pool_try_alloc(fifo))) {
+                bufs[count]->type = BUF_DEMUX_BLOCK;
+                bufs[count]->content = bufs[count]->mem;
+                ++count;
+            }
+            for (int i = 0; i < count; ++i) {
+                vec[i].iov_base = bufs[i]->mem;
+                vec[i].iov_len = todo;
+                bufs[i]->size = todo;
+            }
+            if (that->bytestream()->readVector(vec, count) < count * todo) {
+                // only a stopped ByteStream returns less than it has available
+                for (int i = 0; i < count; ++i) {
+                    bufs[i]->free_buffer(bufs[i]);
+                }
+                return NULL;
+            }
+            that->setReadAhead(fifo, bufs + 1, count - 1);
+            return buf;
+        }
+    }
+
+    // readFromBuffer consumes chunk after chunk until todo bytes are copied, it only returns less
+    // at the end of the stream
+    const off_t num_bytes = that->bytestream()->readFromBuffer(buf->mem, todo);
+    if (num_bytes <= 0) {
+        buf->free_buffer(buf);
+        return NULL;
+    }
+    buf->size = num_bytes;
+
     return buf;
 }
 
 static off_t kbytestream_plugin_seek (input_plugin_t *this_gen, off_t offset, int origin)
 {
     KByteStreamInputPlugin *that = static_cast<KByteStreamInputPlugin *>(this_gen);
+    that->dropReadAhead();
     switch (origin) {
     case SEEK_SET:
         break;
@@ -146,7 +316,7 @@ static off_t kbytestream_plugin_seek (input_plugin_t *this_gen, off_t offset, in
 static off_t kbytestream_plugin_get_current_pos (input_plugin_t *this_gen)
 {
     KByteStreamInputPlugin *that = static_cast<KByteStreamInputPlugin *>(this_gen);
-    return that->bytestream()->currentPosition();
+    return that->currentPosition();
 }
 
 static off_t kbytestream_plugin_get_length (input_plugin_t *this_gen)
@@ -203,6 +373,8 @@ static int kbytestream_plugin_open (input_plugin_t *this_gen)
     }
 
     Q_ASSERT(that->bytestream());
+    // the reset discards the data the buffers were read from
+    that->clearReadAhead();
     that->bytestream()->reset();
 
     return 1;
@@ -0,0 +1,68 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_BYTESTREAMSTATISTICS_H
+#define PHONON_XINE_BYTESTREAMSTATISTICS_H
+
+#include <QtCore/QtGlobal>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief Snapshot of the I/O counters of a ByteStream.
+ *
+ * The counters are sampled without any synchronization between them, so they are not guaranteed
+ * to be consistent with each other.
+ */
+struct ByteStreamStatistics
+{
+    ByteStreamStatistics()
+        : bytesQueued(0), peakBytesQueued(0), blockedTime(0), underruns(0), bufferedSeeks(0),
+        cachedSeeks(0), producerSeeks(0), needDataCalls(0), enoughDataCalls(0), zeroCopyReads(0),
+        copiedReads(0)
+    {}
+
+    // bytes written by the StreamInterface that the xine thread has not read yet, including the
+    // ones waiting for room in the ring
+    int bytesQueued;
+    int peakBytesQueued;
+    // milliseconds the xine thread was blocked in readFromBuffer or peekBuffer
+    int blockedTime;
+    // how often readFromBuffer ran out of data (not counting the waits after a seek)
+    int underruns;
+    // seeks served from the buffered or already read data, from the disk cache and by the
+    // StreamInterface
+    int bufferedSeeks;
+    int cachedSeeks;
+    int producerSeeks;
+    int needDataCalls;
+    int enoughDataCalls;
+    // reads handed to xine as a reference to a received chunk and reads copied to xine's memory
+    int zeroCopyReads;
+    int copiedReads;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_BYTESTREAMSTATISTICS_H
+// vim: sw=4 ts=4 sts=4 et tw=100
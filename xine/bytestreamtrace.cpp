@@ -0,0 +1,143 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "bytestreamtrace.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QtDebug>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+ByteStreamTraceWriter::ByteStreamTraceWriter(const QString &fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "cannot write the ByteStream trace" << fileName << ":" << m_file.errorString();
+        return;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_4_4);
+    m_stream << quint32(ByteStreamTrace::Magic) << quint16(ByteStreamTrace::Version);
+    m_time.start();
+}
+
+// m_mutex must be locked
+inline void ByteStreamTraceWriter::writeHeader(ByteStreamTraceRecord::Type type)
+{
+    m_stream << quint8(type) << quint32(m_time.elapsed());
+}
+
+void ByteStreamTraceWriter::record(ByteStreamTraceRecord::Type type, qint64 value)
+{
+    Q_ASSERT(type != ByteStreamTraceRecord::Data);
+    if (!isValid()) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    writeHeader(type);
+    switch (type) {
+    case ByteStreamTraceRecord::StreamSize:
+    case ByteStreamTraceRecord::Seekable:
+    case ByteStreamTraceRecord::Seek:
+        m_stream << value;
+        break;
+    default:
+        break;
+    }
+}
+
+void ByteStreamTraceWriter::recordData(const QByteArray &data)
+{
+    if (!isValid()) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    writeHeader(ByteStreamTraceRecord::Data);
+    m_stream << data;
+}
+
+ByteStreamTraceReader::ByteStreamTraceReader()
+{
+}
+
+bool ByteStreamTraceReader::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "cannot read the ByteStream trace" << fileName << ":" << m_file.errorString();
+        return false;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_4_4);
+    quint32 magic;
+    quint16 version;
+    m_stream >> magic >> version;
+    if (magic != ByteStreamTrace::Magic || version != ByteStreamTrace::Version) {
+        qWarning() << fileName << "is not a ByteStream trace of version" << ByteStreamTrace::Version;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ByteStreamTraceReader::close()
+{
+    m_stream.setDevice(0);
+    m_file.close();
+}
+
+bool ByteStreamTraceReader::readRecord(ByteStreamTraceRecord *record)
+{
+    if (!m_file.isOpen() || m_stream.atEnd()) {
+        return false;
+    }
+    quint8 type;
+    m_stream >> type >> record->time;
+    record->type = static_cast<ByteStreamTraceRecord::Type>(type);
+    record->value = 0;
+    record->data.clear();
+    switch (record->type) {
+    case ByteStreamTraceRecord::Data:
+        m_stream >> record->data;
+        break;
+    case ByteStreamTraceRecord::StreamSize:
+    case ByteStreamTraceRecord::Seekable:
+    case ByteStreamTraceRecord::Seek:
+        m_stream >> record->value;
+        break;
+    case ByteStreamTraceRecord::EndOfData:
+    case ByteStreamTraceRecord::Reset:
+    case ByteStreamTraceRecord::NeedData:
+    case ByteStreamTraceRecord::EnoughData:
+        break;
+    default:
+        qWarning() << "unknown record type" << type << "in the ByteStream trace";
+        return false;
+    }
+    return m_stream.status() == QDataStream::Ok;
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,126 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_BYTESTREAMTRACE_H
+#define PHONON_XINE_BYTESTREAMTRACE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QTime>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * One entry of a ByteStream trace.
+ *
+ * A trace file starts with the magic number and the format version, followed by the records.
+ * Every record is the type (quint8) and the milliseconds since the start of the recording
+ * (quint32), followed by the data chunk for Data records or by the offset/size (qint64) for
+ * StreamSize, Seekable and Seek records.
+ */
+struct ByteStreamTraceRecord
+{
+    enum Type {
+        Invalid = 0,
+        // writeData
+        Data = 1,
+        // setStreamSize
+        StreamSize = 2,
+        // setStreamSeekable
+        Seekable = 3,
+        // endOfData
+        EndOfData = 4,
+        // seekStream was called, the following data starts at the offset
+        Seek = 5,
+        // reset was called, the following data starts at 0
+        Reset = 6,
+        NeedData = 7,
+        EnoughData = 8
+    };
+
+    ByteStreamTraceRecord() : type(Invalid), time(0), value(0) {}
+
+    Type type;
+    quint32 time;
+    qint64 value;
+    QByteArray data;
+};
+
+/**
+ * \brief Records the traffic between a StreamInterface and its ByteStream to a file.
+ *
+ * Can be called from any thread.
+ */
+class ByteStreamTraceWriter
+{
+    public:
+        explicit ByteStreamTraceWriter(const QString &fileName);
+
+        bool isValid() const { return m_file.isOpen(); }
+
+        void record(ByteStreamTraceRecord::Type type, qint64 value = 0);
+        void recordData(const QByteArray &data);
+
+    private:
+        void writeHeader(ByteStreamTraceRecord::Type type);
+
+        QMutex m_mutex;
+        QFile m_file;
+        QDataStream m_stream;
+        QTime m_time;
+};
+
+/**
+ * \brief Reads the records of a trace written by ByteStreamTraceWriter.
+ */
+class ByteStreamTraceReader
+{
+    public:
+        ByteStreamTraceReader();
+
+        bool open(const QString &fileName);
+        void close();
+        // returns false at the end of the trace or if the trace is broken
+        bool readRecord(ByteStreamTraceRecord *record);
+
+    private:
+        QFile m_file;
+        QDataStream m_stream;
+};
+
+namespace ByteStreamTrace
+{
+    enum {
+        // "PXBT"
+        Magic = 0x50584254,
+        Version = 1
+    };
+} // namespace ByteStreamTrace
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_BYTESTREAMTRACE_H
+// vim: sw=4 ts=4 sts=4 et tw=100
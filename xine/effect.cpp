@@ -340,7 +340,7 @@ void Effect::aboutToChangeXineEngine()
         xt->m_plugin = 0;
         xt->m_pluginApi = 0;
         xt->m_fakeAudioPort = 0;
-        KeepReference<> *keep = new KeepReference<>;
+        KeepReference<> *keep = new KeepReference<>(source() ? source()->streamThread() : 0);
         keep->addObject(static_cast<SinkNodeXT *>(xt2));
         keep->ready();
     }
@@ -95,14 +95,12 @@ public:
         UnpauseForBuffering,
         Error,
         NewStream,
-        NewMetaData,
+        XineNotifications,
         MediaFinished,
-        Progress,
         NavButtonIn,
         NavButtonOut,
         AudioDeviceFailed,
         FrameFormatChange,
-        UiChannelsChanged,
         Reference,
         Rewire,
         HasVideo,
@@ -139,7 +137,6 @@ EVENT_CLASS1(SetPrefinishMark, qint32 i, time(i), const qint32, time)
 EVENT_CLASS2(RequestSnapshot, QImage& i, QWaitCondition *w, image(i), waitCondition(w), QImage&, image, QWaitCondition *, waitCondition)
 EVENT_CLASS2(Rewire, QList<WireCall> _wireCalls, QList<WireCall> _unwireCalls, wireCalls(_wireCalls), unwireCalls(_unwireCalls), const QList<WireCall>, wireCalls, const QList<WireCall>, unwireCalls)
 EVENT_CLASS2(Reference, bool alt, const QByteArray &m, alternative(alt), mrl(m), const bool, alternative, const QByteArray, mrl)
-EVENT_CLASS2(Progress, const QString &d, int p, description(d), percent(p), const QString, description, const int, percent)
 EVENT_CLASS2(Error, Phonon::ErrorType t, const QString &r, type(t), reason(r), const Phonon::ErrorType, type, const QString, reason)
 EVENT_CLASS2(SetParam, int p, int v, param(p), value(v), const int, param, const int, value)
 EVENT_CLASS2(MrlChanged, const QByteArray &_mrl, XineStream::StateForNewMrl _s, mrl(_mrl), stateForNewMrl(_s), const QByteArray, mrl, const XineStream::StateForNewMrl, stateForNewMrl)
@@ -35,14 +35,20 @@ template<int TIME = 10000>
 class KeepReference : public QObject
 {
     public:
-        inline KeepReference()
+        // The references are dropped in \p thread, by default in the first XineThread. Pass the
+        // thread of the stream that uses the objects (SourceNode::streamThread()).
+        inline KeepReference(QThread *thread = 0)
+            : m_thread(qobject_cast<XineThread *>(thread))
         {
+            if (!m_thread) {
+                m_thread = XineThread::instance();
+            }
             //moveToThread(QApplication::instance()->thread());
-            moveToThread(XineThread::instance());
-            Backend::addCleanupObject(this);
+            moveToThread(m_thread);
+            m_thread->addCleanupObject(this);
         }
 
-        inline ~KeepReference() { Backend::removeCleanupObject(this); }
+        inline ~KeepReference() { m_thread->removeCleanupObject(this); }
 
         inline void addObject(SharedData *o) { objects << QExplicitlySharedDataPointer<SharedData>(o); }
         inline void ready() {
@@ -68,6 +74,7 @@ class KeepReference : public QObject
         }
 
     private:
+        XineThread *m_thread;
         QList<QExplicitlySharedDataPointer<SharedData> > objects;
 };
 
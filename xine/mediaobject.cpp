@@ -23,6 +23,7 @@
 #include "mediaobject.h"
 
 #include "bytestream.h"
+#include "backend.h"
 
 #include <QEvent>
 #include <QFile>
@@ -147,6 +148,26 @@ qint64 MediaObject::currentTime() const
     return -1;
 }
 
+/**
+ * The position in microseconds, derived from the clock of xine instead of being extrapolated from
+ * the last currentTime() update.
+ */
+qint64 MediaObject::currentTimeUsecs() const
+{
+    switch(m_stream->state()) {
+    case Phonon::PausedState:
+    case Phonon::BufferingState:
+    case Phonon::PlayingState:
+        return m_stream->currentTimeUsecs();
+    case Phonon::StoppedState:
+    case Phonon::LoadingState:
+        return 0;
+    case Phonon::ErrorState:
+        break;
+    }
+    return -1;
+}
+
 qint64 MediaObject::totalTime() const
 {
     const qint64 ret = m_stream->totalTime();
@@ -270,6 +291,39 @@ qint32 MediaObject::transitionTime() const
     return m_transitionTime;
 }
 
+/**
+ * How many bytes of ByteStream data may be cached on disk. The application can set the
+ * "streamCacheSize" property on the frontend object, otherwise the configured size is used.
+ */
+qint64 MediaObject::streamCacheSize() const
+{
+    const QVariant size = parent() ? parent()->property("streamCacheSize") : QVariant();
+    if (size.isValid()) {
+        return size.toLongLong();
+    }
+    return Backend::streamCacheSize();
+}
+
+QString MediaObject::streamCacheDirectory() const
+{
+    const QVariant directory = parent() ? parent()->property("streamCacheDirectory") : QVariant();
+    if (directory.isValid()) {
+        return directory.toString();
+    }
+    return Backend::streamCacheDirectory();
+}
+
+/**
+ * The I/O statistics of the current source if it is a stream, otherwise all counters are 0.
+ */
+ByteStreamStatistics MediaObject::byteStreamStatistics() const
+{
+    if (m_bytestream) {
+        return m_bytestream->statistics();
+    }
+    return ByteStreamStatistics();
+}
+
 void MediaObject::setTransitionTime(qint32 newTransitionTime)
 {
     if (m_transitionTime != newTransitionTime) {
@@ -336,6 +390,18 @@ static QByteArray mrlEncode(QByteArray mrl)
     return mrl;
 }
 
+/**
+ * Returns the MRL xine opens \p url with. Local files are passed in the local 8-bit encoding,
+ * everything else percent encoded.
+ */
+QByteArray MediaObject::mrlForUrl(const QUrl &url)
+{
+    if (url.scheme() == QLatin1String("file")) {
+        return "file:/" + mrlEncode(url.toLocalFile().toLocal8Bit());
+    }
+    return url.toEncoded();
+}
+
 void MediaObject::setSourceInternal(const MediaSource &source, HowToSetTheUrl how)
 {
     //debug() << Q_FUNC_INFO;
@@ -360,9 +426,7 @@ void MediaObject::setSourceInternal(const MediaSource &source, HowToSetTheUrl ho
             return;
         }
         {
-            const QByteArray &mrl = (source.url().scheme() == QLatin1String("file") ?
-                    "file:/" + mrlEncode (source.url().toLocalFile().toLocal8Bit()) :
-                    source.url().toEncoded());
+            const QByteArray &mrl = mrlForUrl(source.url());
             switch (how) {
                 case GaplessSwitch:
                     m_stream->gaplessSwitchTo(mrl);
@@ -34,9 +34,11 @@
 #include <QHash>
 #include <QMultiMap>
 #include <QPointer>
+#include <QUrl>
 
 #include <xine.h>
 #include "sourcenode.h"
+#include "bytestreamstatistics.h"
 
 namespace Phonon
 {
@@ -59,6 +61,7 @@ class MediaObject : public QObject, public MediaObjectInterface, public AddonInt
         qint64 currentTime() const;
         qint64 totalTime() const;
         Q_INVOKABLE qint64 remainingTime() const;
+        Q_INVOKABLE qint64 currentTimeUsecs() const;
         qint32 tickInterval() const;
 
         void setTickInterval(qint32 newTickInterval);
@@ -82,6 +85,11 @@ class MediaObject : public QObject, public MediaObjectInterface, public AddonInt
         Q_INVOKABLE qint32 transitionTime() const;
         Q_INVOKABLE void setTransitionTime(qint32 newTransitionTime);
 
+        qint64 streamCacheSize() const;
+        QString streamCacheDirectory() const;
+
+        ByteStreamStatistics byteStreamStatistics() const;
+
         MediaSource source() const;
         void setSource(const MediaSource &source);
         void setNextSource(const MediaSource &source);
@@ -89,6 +97,8 @@ class MediaObject : public QObject, public MediaObjectInterface, public AddonInt
         MediaStreamTypes outputMediaStreamTypes() const;
         void upstreamEvent(Event *e);
 
+        static QByteArray mrlForUrl(const QUrl &url);
+
     public slots:
         void downstreamEvent(Event *e);
 
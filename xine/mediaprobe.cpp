@@ -0,0 +1,218 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "mediaprobe.h"
+#include "backend.h"
+#include "mediaobject.h"
+#include "metadatacache.h"
+#include "xineengine.h"
+#include "xinestream.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <xine.h>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+static QVariantMap toVariantMap(const MetaDataCache::Entry &entry)
+{
+    QVariantMap metaData;
+    foreach (const QString &key, entry.metaData.uniqueKeys()) {
+        metaData.insert(key, QStringList(entry.metaData.values(key)));
+    }
+    QVariantMap info;
+    info.insert(QLatin1String("totalTime"), entry.totalTime);
+    info.insert(QLatin1String("hasVideo"), entry.hasVideo);
+    info.insert(QLatin1String("isSeekable"), entry.isSeekable);
+    info.insert(QLatin1String("availableTitles"), entry.availableTitles);
+    info.insert(QLatin1String("availableChapters"), entry.availableChapters);
+    info.insert(QLatin1String("availableAngles"), entry.availableAngles);
+    info.insert(QLatin1String("availableSubtitles"), entry.availableSubtitles);
+    info.insert(QLatin1String("availableAudioChannels"), entry.availableAudioChannels);
+    info.insert(QLatin1String("width"), entry.width);
+    info.insert(QLatin1String("height"), entry.height);
+    info.insert(QLatin1String("metaData"), metaData);
+    return info;
+}
+
+MediaProbeWorker::MediaProbeWorker(MediaProbe *probe)
+    : m_probe(probe)
+{
+}
+
+void MediaProbeWorker::run()
+{
+    // on a miss of the engine pool xine_init runs here
+    const XineEngine engine = Backend::xineEngineForStream();
+    // one stream is opened and closed for every URL, it never plays
+    xine_audio_port_t *audioPort = xine_open_audio_driver(engine, "none", 0);
+    xine_video_port_t *videoPort = xine_open_video_driver(engine, "auto", XINE_VISUAL_TYPE_NONE, 0);
+    xine_stream_t *stream = xine_stream_new(engine, audioPort, videoPort);
+    if (!stream) {
+        qWarning() << "MediaProbe: cannot create a xine stream";
+    }
+    MetaDataCache *cache = Backend::metaDataCache();
+
+    QUrl url;
+    while (m_probe->takeNext(&url)) {
+        // a ByteStream needs a MediaObject feeding it
+        if (!stream || !url.isValid() || url.scheme() == QLatin1String("kbytestream")) {
+            debug() << Q_FUNC_INFO << "cannot open" << url;
+            emit probeFailed(url);
+            continue;
+        }
+        const QByteArray mrl = MediaObject::mrlForUrl(url);
+        MetaDataCache::Entry entry;
+        if (!cache || !cache->find(mrl, &entry)) {
+            if (!xine_open(stream, mrl.constData())) {
+                debug() << Q_FUNC_INFO << "cannot open" << mrl.constData();
+                xine_close(stream);
+                emit probeFailed(url);
+                continue;
+            }
+            int currentTime;
+            xine_get_pos_length(stream, 0, &currentTime, &entry.totalTime);
+            entry.metaData = XineStream::readMetaData(stream);
+            entry.hasVideo = xine_get_stream_info(stream, XINE_STREAM_INFO_HAS_VIDEO);
+            entry.isSeekable = xine_get_stream_info(stream, XINE_STREAM_INFO_SEEKABLE);
+            entry.availableTitles = xine_get_stream_info(stream, XINE_STREAM_INFO_DVD_TITLE_COUNT);
+            entry.availableChapters = xine_get_stream_info(stream, XINE_STREAM_INFO_DVD_CHAPTER_COUNT);
+            entry.availableAngles = xine_get_stream_info(stream, XINE_STREAM_INFO_DVD_ANGLE_COUNT);
+            entry.availableSubtitles = xine_get_stream_info(stream, XINE_STREAM_INFO_MAX_SPU_CHANNEL);
+            entry.availableAudioChannels = xine_get_stream_info(stream, XINE_STREAM_INFO_MAX_AUDIO_CHANNEL);
+            if (entry.hasVideo) {
+                entry.width = xine_get_stream_info(stream, XINE_STREAM_INFO_VIDEO_WIDTH);
+                entry.height = xine_get_stream_info(stream, XINE_STREAM_INFO_VIDEO_HEIGHT);
+            }
+            xine_close(stream);
+            if (cache) {
+                cache->insert(mrl, entry);
+            }
+        }
+        emit probed(url, toVariantMap(entry));
+    }
+
+    if (stream) {
+        xine_dispose(stream);
+    }
+    if (videoPort) {
+        xine_close_video_driver(engine, videoPort);
+    }
+    if (audioPort) {
+        xine_close_audio_driver(engine, audioPort);
+    }
+    Backend::returnXineEngine(engine);
+}
+
+MediaProbe::MediaProbe(QObject *parent)
+    : QObject(parent)
+{
+}
+
+MediaProbe::~MediaProbe()
+{
+    cancel();
+    foreach (MediaProbeWorker *worker, m_workers) {
+        // the URL a worker currently opens is finished first
+        worker->wait();
+        delete worker;
+    }
+}
+
+/**
+ * Appends \p urls to the queue and starts as many workers as are allowed and useful.
+ */
+// called from main thread
+void MediaProbe::probe(const QList<QUrl> &urls)
+{
+    m_mutex.lock();
+    foreach (const QUrl &url, urls) {
+        m_queue.enqueue(url);
+    }
+    m_mutex.unlock();
+    startWorkers();
+}
+
+/**
+ * Drops the URLs that were not taken by a worker yet. The URLs that are being opened are still
+ * reported.
+ */
+// called from main thread
+void MediaProbe::cancel()
+{
+    QMutexLocker lock(&m_mutex);
+    m_queue.clear();
+}
+
+// worker threads
+bool MediaProbe::takeNext(QUrl *url)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_queue.isEmpty()) {
+        return false;
+    }
+    *url = m_queue.dequeue();
+    return true;
+}
+
+// called from main thread
+void MediaProbe::startWorkers()
+{
+    m_mutex.lock();
+    const int count = qMin(Backend::probeThreadCount() - m_workers.size(), m_queue.size());
+    m_mutex.unlock();
+    for (int i = 0; i < count; ++i) {
+        MediaProbeWorker *worker = new MediaProbeWorker(this);
+        connect(worker, SIGNAL(probed(const QUrl &, const QVariantMap &)),
+                SIGNAL(probed(const QUrl &, const QVariantMap &)));
+        connect(worker, SIGNAL(probeFailed(const QUrl &)), SIGNAL(probeFailed(const QUrl &)));
+        connect(worker, SIGNAL(finished()), SLOT(workerFinished()));
+        m_workers << worker;
+        worker->start(QThread::LowPriority);
+    }
+}
+
+// called from main thread
+void MediaProbe::workerFinished()
+{
+    MediaProbeWorker *worker = qobject_cast<MediaProbeWorker *>(sender());
+    Q_ASSERT(worker);
+    worker->wait();
+    m_workers.removeAll(worker);
+    worker->deleteLater();
+
+    m_mutex.lock();
+    // URLs queued after the worker found the queue empty
+    const bool pending = !m_queue.isEmpty();
+    m_mutex.unlock();
+    if (pending) {
+        startWorkers();
+    } else if (m_workers.isEmpty()) {
+        emit finished();
+    }
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+#include "mediaprobe.moc"
+// vim: sw=4 ts=4 sts=4 et tw=100
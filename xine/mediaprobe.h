@@ -0,0 +1,116 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_MEDIAPROBE_H
+#define PHONON_XINE_MEDIAPROBE_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+#include <QtCore/QVariant>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+class MediaProbe;
+
+/**
+ * \brief Opens the URLs queued in a MediaProbe one after another, with an engine of its own.
+ *
+ * The engine is taken from the backend and returned to it in the worker thread, creating one
+ * never blocks the main thread.
+ */
+class MediaProbeWorker : public QThread
+{
+    Q_OBJECT
+    public:
+        MediaProbeWorker(MediaProbe *probe);
+
+    signals:
+        void probed(const QUrl &url, const QVariantMap &info);
+        void probeFailed(const QUrl &url);
+
+    protected:
+        void run();
+
+    private:
+        MediaProbe *const m_probe;
+};
+
+/**
+ * \brief Reads the meta data and stream info of many URLs, without any MediaObject.
+ *
+ * The URLs are opened concurrently by up to Backend::probeThreadCount() worker threads. Every
+ * worker takes an engine from the backend and plays to null audio and video ports, nothing is
+ * decoded. Results from the meta data cache are used without opening the URL, and new results
+ * are stored in it.
+ *
+ * Applications get a MediaProbe from Backend::createMediaProbe. Every URL is turned into the MRL
+ * MediaObject would open it with, so the results share the meta data cache entries of MediaObject.
+ * The signals carry the URLs back as they were given. probed() and probeFailed() arrive in no
+ * particular order, finished() follows once every queued URL was handled.
+ *
+ * The info passed with probed() has the keys "totalTime", "hasVideo", "isSeekable",
+ * "availableTitles", "availableChapters", "availableAngles", "availableSubtitles",
+ * "availableAudioChannels", "width", "height" and "metaData". The meta data maps every key to a
+ * QStringList.
+ */
+class MediaProbe : public QObject
+{
+    Q_OBJECT
+    public:
+        MediaProbe(QObject *parent = 0);
+        ~MediaProbe();
+
+        Q_INVOKABLE void probe(const QList<QUrl> &urls);
+        Q_INVOKABLE void cancel();
+        Q_INVOKABLE bool isRunning() const { return !m_workers.isEmpty(); }
+
+        // worker threads
+        bool takeNext(QUrl *url);
+
+    signals:
+        void probed(const QUrl &url, const QVariantMap &info);
+        void probeFailed(const QUrl &url);
+        void finished();
+
+    private slots:
+        void workerFinished();
+
+    private:
+        void startWorkers();
+
+        // guards m_queue, which the workers take their URLs from
+        QMutex m_mutex;
+        QQueue<QUrl> m_queue;
+        // only used from the main thread
+        QList<MediaProbeWorker *> m_workers;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_MEDIAPROBE_H
+// vim: sw=4 ts=4 sts=4 et tw=100
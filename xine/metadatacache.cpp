@@ -0,0 +1,392 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "metadatacache.h"
+#include "backend.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QtAlgorithms>
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+bool MetaDataCache::Entry::operator==(const Entry &rhs) const
+{
+    return metaData == rhs.metaData && totalTime == rhs.totalTime && hasVideo == rhs.hasVideo &&
+        isSeekable == rhs.isSeekable && availableTitles == rhs.availableTitles &&
+        availableChapters == rhs.availableChapters && availableAngles == rhs.availableAngles &&
+        availableSubtitles == rhs.availableSubtitles &&
+        availableAudioChannels == rhs.availableAudioChannels && width == rhs.width &&
+        height == rhs.height;
+}
+
+MetaDataCache::MetaDataCache(const QString &fileName, qint64 maxSize)
+    : m_file(fileName),
+    m_device(0),
+    m_inode(0),
+    m_maxSize(maxSize),
+    m_map(0),
+    m_mappedSize(0),
+    m_scannedSize(sizeof(FileHeader))
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    if (!open()) {
+        qWarning() << "cannot open the meta data cache" << fileName << ":" << m_file.errorString();
+        return;
+    }
+    debug() << Q_FUNC_INFO << "caching meta data in" << fileName;
+}
+
+MetaDataCache::~MetaDataCache()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+/**
+ * Returns whether \p mrl is a local file and fills in the size and modification time of the
+ * file, which have to match for a cache entry to be used.
+ */
+bool MetaDataCache::fileKey(const QByteArray &mrl, qint64 *size, qint64 *mtime)
+{
+    if (!mrl.startsWith("file:/")) {
+        return false;
+    }
+    // MediaObject creates "file:/" followed by the percent encoded absolute path
+    const QByteArray path = QByteArray::fromPercentEncoding(mrl.mid(6));
+    // QFileInfo::lastModified has a resolution of one second, a file rewritten within the same
+    // second as it was cached would keep the old entry
+    struct stat st;
+    if (::stat(path.constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    *size = st.st_size;
+#ifdef Q_OS_MAC
+    const long nsec = st.st_mtimespec.tv_nsec;
+#else
+    const long nsec = st.st_mtim.tv_nsec;
+#endif
+    *mtime = static_cast<qint64>(st.st_mtime) * 1000 + nsec / 1000000;
+    return true;
+}
+
+// m_mutex must be locked
+bool MetaDataCache::open()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = 0;
+    }
+    m_mappedSize = 0;
+    m_scannedSize = sizeof(FileHeader);
+    m_index.clear();
+
+    // unbuffered appends, so that every record goes to the end of the file in one write
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered)) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(m_file.handle(), &st) == 0) {
+        m_device = st.st_dev;
+        m_inode = st.st_ino;
+    }
+    bool valid = false;
+    if (m_file.size() >= static_cast<qint64>(sizeof(FileHeader))) {
+        uchar *map = m_file.map(0, sizeof(FileHeader));
+        if (map) {
+            FileHeader header;
+            memcpy(&header, map, sizeof(FileHeader));
+            valid = header.magic == FileMagic && header.version == FileVersion;
+            m_file.unmap(map);
+        }
+    }
+    if (!valid) {
+        // empty, or written by an incompatible version
+        FileHeader header;
+        header.magic = FileMagic;
+        header.version = FileVersion;
+        if (!m_file.resize(0) ||
+                m_file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader)) != sizeof(FileHeader)) {
+            m_file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns whether the file name refers to another file than the one that is open, i.e. another
+ * process compacted the cache or removed it.
+ */
+// m_mutex must be locked
+bool MetaDataCache::fileReplaced() const
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(m_file.fileName()).constData(), &st) != 0) {
+        return true;
+    }
+    return static_cast<quint64>(st.st_dev) != m_device || static_cast<quint64>(st.st_ino) != m_inode;
+}
+
+/**
+ * Maps the whole file again if it grew, and adds the records that were appended since the last
+ * call to the index. Records may have been appended by other processes. If another process
+ * replaced the file, the new one is opened and indexed from the start.
+ */
+// m_mutex must be locked
+bool MetaDataCache::remap()
+{
+    if (fileReplaced()) {
+        debug() << Q_FUNC_INFO << "the cache file was replaced, opening it again";
+        if (m_map) {
+            m_file.unmap(m_map);
+            m_map = 0;
+        }
+        m_file.close();
+        if (!open()) {
+            qWarning() << "cannot open the meta data cache" << m_file.fileName() << ":" << m_file.errorString();
+            return false;
+        }
+    }
+    const qint64 size = m_file.size();
+    if (m_map && size == m_mappedSize) {
+        return true;
+    }
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+    m_map = m_file.map(0, size);
+    if (!m_map) {
+        m_mappedSize = 0;
+        qWarning() << "cannot map the meta data cache:" << m_file.errorString();
+        return false;
+    }
+    m_mappedSize = size;
+
+    qint64 offset = m_scannedSize;
+    while (offset + static_cast<qint64>(sizeof(RecordHeader)) <= size) {
+        RecordHeader header;
+        memcpy(&header, m_map + offset, sizeof(RecordHeader));
+        if (header.magic != RecordMagic || header.size > MaxRecordSize) {
+            // garbage of a partially written record, look for the next one
+            ++offset;
+            continue;
+        }
+        const qint64 end = offset + sizeof(RecordHeader) + header.size;
+        if (end > size) {
+            // the record is still being written, or it never will be. In the latter case the
+            // checksum fails as soon as the file grew past its end
+            break;
+        }
+        const char *payload = reinterpret_cast<const char *>(m_map) + offset + sizeof(RecordHeader);
+        if (qChecksum(payload, header.size) != header.checksum) {
+            ++offset;
+            continue;
+        }
+        QByteArray mrl;
+        QDataStream stream(QByteArray::fromRawData(payload, header.size));
+        stream.setVersion(QDataStream::Qt_4_4);
+        stream >> mrl;
+        m_index.insert(mrl, offset);
+        offset = end;
+    }
+    m_scannedSize = offset;
+    return true;
+}
+
+// m_mutex must be locked, offset has to come from m_index
+bool MetaDataCache::readRecord(qint64 offset, QByteArray *mrl, qint64 *size, qint64 *mtime, Entry *entry) const
+{
+    RecordHeader header;
+    memcpy(&header, m_map + offset, sizeof(RecordHeader));
+    const char *payload = reinterpret_cast<const char *>(m_map) + offset + sizeof(RecordHeader);
+    QDataStream stream(QByteArray::fromRawData(payload, header.size));
+    stream.setVersion(QDataStream::Qt_4_4);
+    qint32 totalTime, titles, chapters, angles, subtitles, audioChannels, width, height;
+    stream >> *mrl >> *size >> *mtime >> entry->metaData >> totalTime >> entry->hasVideo
+        >> entry->isSeekable >> titles >> chapters >> angles >> subtitles >> audioChannels
+        >> width >> height;
+    entry->totalTime = totalTime;
+    entry->availableTitles = titles;
+    entry->availableChapters = chapters;
+    entry->availableAngles = angles;
+    entry->availableSubtitles = subtitles;
+    entry->availableAudioChannels = audioChannels;
+    entry->width = width;
+    entry->height = height;
+    return stream.status() == QDataStream::Ok;
+}
+
+QByteArray MetaDataCache::record(const QByteArray &mrl, qint64 size, qint64 mtime, const Entry &entry) const
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_4);
+    stream << mrl << size << mtime << entry.metaData << static_cast<qint32>(entry.totalTime)
+        << entry.hasVideo << entry.isSeekable << static_cast<qint32>(entry.availableTitles)
+        << static_cast<qint32>(entry.availableChapters) << static_cast<qint32>(entry.availableAngles)
+        << static_cast<qint32>(entry.availableSubtitles)
+        << static_cast<qint32>(entry.availableAudioChannels) << static_cast<qint32>(entry.width)
+        << static_cast<qint32>(entry.height);
+
+    RecordHeader header;
+    header.magic = RecordMagic;
+    header.size = payload.size();
+    header.checksum = qChecksum(payload.constData(), payload.size());
+    return QByteArray(reinterpret_cast<const char *>(&header), sizeof(RecordHeader)) + payload;
+}
+
+/**
+ * Rewrites the file with the newest record of every MRL, dropping the oldest ones so that the
+ * new file uses at most half of the allowed size. The new file replaces the old one atomically,
+ * other processes keep using the old one until they open the cache again.
+ */
+// m_mutex must be locked
+void MetaDataCache::compact()
+{
+    QList<qint64> offsets = m_index.values();
+    // the newest records are at the end of the file
+    qSort(offsets.begin(), offsets.end(), qGreater<qint64>());
+
+    FileHeader fileHeader;
+    fileHeader.magic = FileMagic;
+    fileHeader.version = FileVersion;
+    QByteArray data(reinterpret_cast<const char *>(&fileHeader), sizeof(FileHeader));
+    foreach (qint64 offset, offsets) {
+        RecordHeader header;
+        memcpy(&header, m_map + offset, sizeof(RecordHeader));
+        const int recordSize = sizeof(RecordHeader) + header.size;
+        if (data.size() + recordSize > m_maxSize / 2) {
+            break;
+        }
+        data.append(reinterpret_cast<const char *>(m_map) + offset, recordSize);
+    }
+
+    // a name of its own, other processes may be compacting at the same time. The file is removed
+    // again unless it was renamed over the cache.
+    const QString fileName = m_file.fileName();
+    QTemporaryFile newFile(fileName + QLatin1String(".XXXXXX"));
+    if (!newFile.open() || newFile.write(data) != data.size() || !newFile.flush()) {
+        qWarning() << "cannot compact the meta data cache:" << newFile.errorString();
+        return;
+    }
+    if (::rename(QFile::encodeName(newFile.fileName()).constData(), QFile::encodeName(fileName).constData()) != 0) {
+        qWarning() << "cannot replace the meta data cache" << fileName;
+        return;
+    }
+    newFile.setAutoRemove(false);
+    debug() << Q_FUNC_INFO << "kept" << data.size() << "of" << m_mappedSize << "bytes";
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = 0;
+    }
+    m_file.close();
+    if (!open() || !remap()) {
+        qWarning() << "cannot open the meta data cache" << fileName << ":" << m_file.errorString();
+    }
+}
+
+/**
+ * Fills in \p entry and returns true if \p mrl was stored and the file did not change since.
+ */
+// any thread
+bool MetaDataCache::find(const QByteArray &mrl, Entry *entry)
+{
+    qint64 size;
+    qint64 mtime;
+    if (!fileKey(mrl, &size, &mtime)) {
+        return false;
+    }
+    QMutexLocker lock(&m_mutex);
+    if (!isValid() || !remap()) {
+        return false;
+    }
+    const QHash<QByteArray, qint64>::ConstIterator it = m_index.constFind(mrl);
+    if (it == m_index.constEnd()) {
+        return false;
+    }
+    QByteArray storedMrl;
+    qint64 storedSize;
+    qint64 storedMtime;
+    Entry stored;
+    if (!readRecord(*it, &storedMrl, &storedSize, &storedMtime, &stored) ||
+            storedMrl != mrl || storedSize != size || storedMtime != mtime) {
+        return false;
+    }
+    *entry = stored;
+    return true;
+}
+
+// any thread
+void MetaDataCache::insert(const QByteArray &mrl, const Entry &entry)
+{
+    qint64 size;
+    qint64 mtime;
+    if (!fileKey(mrl, &size, &mtime)) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    if (!isValid() || !remap()) {
+        return;
+    }
+    const QHash<QByteArray, qint64>::ConstIterator it = m_index.constFind(mrl);
+    if (it != m_index.constEnd()) {
+        QByteArray storedMrl;
+        qint64 storedSize;
+        qint64 storedMtime;
+        Entry stored;
+        if (readRecord(*it, &storedMrl, &storedSize, &storedMtime, &stored) &&
+                storedSize == size && storedMtime == mtime && stored == entry) {
+            // nothing new
+            return;
+        }
+    }
+    const QByteArray data = record(mrl, size, mtime, entry);
+    if (data.size() - static_cast<int>(sizeof(RecordHeader)) > MaxRecordSize) {
+        // remap() would take it for garbage, e.g. a file with huge meta data
+        debug() << Q_FUNC_INFO << "not caching" << mrl << ", the record is" << data.size() << "bytes";
+        return;
+    }
+    if (m_mappedSize + data.size() > m_maxSize) {
+        compact();
+        if (!isValid()) {
+            return;
+        }
+    }
+    // the record is indexed by the next remap, like the ones appended by other processes
+    if (m_file.write(data) != data.size()) {
+        qWarning() << "cannot write to the meta data cache:" << m_file.errorString();
+    }
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
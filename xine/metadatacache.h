@@ -0,0 +1,127 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_METADATACACHE_H
+#define PHONON_XINE_METADATACACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMultiMap>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief Persistent cache of the stream info and meta data of local files.
+ *
+ * Entries are keyed by the MRL together with the size and modification time (in milliseconds) of
+ * the file, so an entry is never used for a file that changed since it was stored. Only file:/ MRLs are cached.
+ *
+ * The cache file is memory mapped and only ever appended to: every record carries its own length
+ * and checksum, so records that were written partially, e.g. by a process that crashed or by two
+ * processes appending at the same time, are skipped. The last record for an MRL wins. When the
+ * file grows beyond the configured size it is compacted to the newest record of every MRL, and
+ * other processes switch to the compacted file the next time they use the cache.
+ *
+ * find() and insert() may be called from any thread.
+ */
+class MetaDataCache
+{
+    public:
+        struct Entry
+        {
+            Entry()
+                : totalTime(-1), hasVideo(false), isSeekable(false), availableTitles(0),
+                availableChapters(0), availableAngles(0), availableSubtitles(0),
+                availableAudioChannels(0), width(0), height(0) {}
+            bool operator==(const Entry &rhs) const;
+
+            QMultiMap<QString, QString> metaData;
+            int totalTime;
+            bool hasVideo;
+            bool isSeekable;
+            int availableTitles;
+            int availableChapters;
+            int availableAngles;
+            int availableSubtitles;
+            int availableAudioChannels;
+            int width;
+            int height;
+        };
+
+        MetaDataCache(const QString &fileName, qint64 maxSize);
+        ~MetaDataCache();
+
+        bool isValid() const { return m_file.isOpen(); }
+
+        bool find(const QByteArray &mrl, Entry *entry);
+        void insert(const QByteArray &mrl, const Entry &entry);
+
+    private:
+        enum {
+            FileMagic = 0x50584d43, // "PXMC"
+            // 2: the modification time is stored in milliseconds
+            FileVersion = 2,
+            RecordMagic = 0x52454331, // "REC1"
+            MaxRecordSize = 64 * 1024
+        };
+        struct FileHeader
+        {
+            quint32 magic;
+            quint32 version;
+        };
+        struct RecordHeader
+        {
+            quint32 magic;
+            quint32 size;
+            quint32 checksum;
+        };
+        static bool fileKey(const QByteArray &mrl, qint64 *size, qint64 *mtime);
+        bool open();
+        bool fileReplaced() const;
+        bool remap();
+        bool readRecord(qint64 offset, QByteArray *mrl, qint64 *size, qint64 *mtime, Entry *entry) const;
+        QByteArray record(const QByteArray &mrl, qint64 size, qint64 mtime, const Entry &entry) const;
+        void compact();
+
+        QMutex m_mutex;
+        QFile m_file;
+        // identify the file m_file has open, to notice when another process renamed its
+        // compacted file over it
+        quint64 m_device;
+        quint64 m_inode;
+        qint64 m_maxSize;
+        uchar *m_map;
+        qint64 m_mappedSize;
+        // records before this offset are in m_index
+        qint64 m_scannedSize;
+        // offset of the newest record for every MRL
+        QHash<QByteArray, qint64> m_index;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_METADATACACHE_H
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,137 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "plugincatalog.h"
+#include "backend.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTemporaryFile>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+enum {
+    CatalogMagic = 0x50584350, // "PXCP"
+    CatalogVersion = 1
+};
+
+static QDataStream &operator<<(QDataStream &stream, const PluginCatalog::Plugin &plugin)
+{
+    return stream << plugin.name << plugin.description;
+}
+
+static QDataStream &operator>>(QDataStream &stream, PluginCatalog::Plugin &plugin)
+{
+    return stream >> plugin.name >> plugin.description;
+}
+
+PluginCatalog PluginCatalog::fromEngine(xine_t *xine)
+{
+    PluginCatalog catalog;
+
+    char *mimeTypes = xine_get_mime_types(xine);
+    catalog.mimeTypes = QString(mimeTypes).split(';', QString::SkipEmptyParts);
+    free(mimeTypes);
+
+    const char *const *outputPlugins = xine_list_audio_output_plugins(xine);
+    for (int i = 0; outputPlugins[i]; ++i) {
+        Plugin plugin;
+        plugin.name = outputPlugins[i];
+        plugin.description = QString(xine_get_audio_driver_plugin_description(xine, outputPlugins[i]));
+        catalog.audioOutputPlugins << plugin;
+    }
+
+    const char *const *postPlugins = xine_list_post_plugins_typed(xine, XINE_POST_TYPE_AUDIO_FILTER);
+    for (int i = 0; postPlugins[i]; ++i) {
+        Plugin plugin;
+        plugin.name = postPlugins[i];
+        plugin.description = QLatin1String(xine_get_post_plugin_description(xine, postPlugins[i]));
+        catalog.audioEffectPlugins << plugin;
+    }
+    return catalog;
+}
+
+bool PluginCatalog::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+    quint32 magic;
+    quint32 version;
+    QByteArray xineVersion;
+    stream >> magic >> version >> xineVersion;
+    if (stream.status() != QDataStream::Ok || magic != CatalogMagic || version != CatalogVersion ||
+            xineVersion != xine_get_version_string()) {
+        debug() << Q_FUNC_INFO << "ignoring the plugin catalog" << fileName;
+        return false;
+    }
+    PluginCatalog catalog;
+    stream >> catalog.mimeTypes >> catalog.audioOutputPlugins >> catalog.audioEffectPlugins;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+    *this = catalog;
+    return true;
+}
+
+void PluginCatalog::save(const QString &fileName) const
+{
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    // other processes may load the catalog at the same time, they only ever see a complete file.
+    // They may save it at the same time as well, so every process writes a file of its own, which
+    // is removed again unless it was renamed over the catalog.
+    QTemporaryFile file(fileName + QLatin1String(".XXXXXX"));
+    if (!file.open()) {
+        qWarning() << "cannot save the plugin catalog:" << file.errorString();
+        return;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_4);
+    stream << static_cast<quint32>(CatalogMagic) << static_cast<quint32>(CatalogVersion)
+        << QByteArray(xine_get_version_string())
+        << mimeTypes << audioOutputPlugins << audioEffectPlugins;
+    if (!file.flush() || file.error() != QFile::NoError ||
+            ::rename(QFile::encodeName(file.fileName()).constData(), QFile::encodeName(fileName).constData()) != 0) {
+        qWarning() << "cannot save the plugin catalog" << fileName;
+        return;
+    }
+    file.setAutoRemove(false);
+}
+
+bool PluginCatalog::operator==(const PluginCatalog &rhs) const
+{
+    return mimeTypes == rhs.mimeTypes && audioOutputPlugins == rhs.audioOutputPlugins &&
+        audioEffectPlugins == rhs.audioEffectPlugins;
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
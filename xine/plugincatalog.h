@@ -0,0 +1,72 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_PLUGINCATALOG_H
+#define PHONON_XINE_PLUGINCATALOG_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include <xine.h>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief What the backend needs to know about the installed xine plugins.
+ *
+ * Reading it from an engine requires xine_init, which scans all plugins. The catalog is saved
+ * so that the next start of the backend can answer the MIME type and device queries right away
+ * and check the saved catalog against the real plugins later. A catalog saved by another xine
+ * version is not loaded.
+ */
+class PluginCatalog
+{
+    public:
+        struct Plugin
+        {
+            QByteArray name;
+            QString description;
+            bool operator==(const Plugin &rhs) const { return name == rhs.name && description == rhs.description; }
+        };
+
+        static PluginCatalog fromEngine(xine_t *xine);
+
+        bool load(const QString &fileName);
+        void save(const QString &fileName) const;
+
+        bool operator==(const PluginCatalog &rhs) const;
+        bool operator!=(const PluginCatalog &rhs) const { return !operator==(rhs); }
+
+        // the MIME types the demuxers handle, as returned by xine_get_mime_types
+        QStringList mimeTypes;
+        QList<Plugin> audioOutputPlugins;
+        // in the order of xine_list_post_plugins_typed, which defines the effect indexes
+        QList<Plugin> audioEffectPlugins;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_PLUGINCATALOG_H
+// vim: sw=4 ts=4 sts=4 et tw=100
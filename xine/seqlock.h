@@ -0,0 +1,106 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_SEQLOCK_H
+#define PHONON_XINE_SEQLOCK_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThread>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief A value written by one thread and read by any number of threads without locking.
+ *
+ * The writer makes the sequence number odd while it changes the value and even again when it is
+ * done. A reader copies the value and retries if the sequence number was odd or changed in the
+ * meantime. Readers never block the writer and the writer never waits for readers.
+ *
+ * \p T has to be a plain struct that can be copied while it is being written to, the copy is
+ * thrown away in that case.
+ *
+ * Reading only loads the sequence number, so readers don't bounce its cache line between the CPUs
+ * like an atomic read-modify-write would.
+ */
+template<typename T>
+class SeqLock
+{
+    public:
+        SeqLock() : m_sequence(0), m_value() {}
+        SeqLock(const T &value) : m_sequence(0), m_value(value) {}
+
+        // writer thread
+        void write(const T &value)
+        {
+            m_sequence.fetchAndAddOrdered(1);
+            m_value = value;
+            m_sequence.fetchAndAddOrdered(1);
+        }
+
+        // writer thread: the writer does not need to check for a concurrent write
+        const T &current() const { return m_value; }
+
+        // any thread
+        T read() const
+        {
+            forever {
+                const int before = m_sequence;
+                if (before & 1) {
+                    // the writer is in the middle of write(), let it finish
+                    QThread::yieldCurrentThread();
+                    continue;
+                }
+                readBarrier();
+                const T value = m_value;
+                // the copy has to be complete before the sequence number is checked again
+                readBarrier();
+                if (m_sequence == before) {
+                    return value;
+                }
+            }
+        }
+
+    private:
+        // keeps the loads before it from being reordered with the loads after it. QAtomicInt in Qt
+        // 4 has no acquire load, reading it is a plain volatile load.
+        static inline void readBarrier()
+        {
+#if defined(Q_CC_GNU) && (defined(__i386__) || defined(__x86_64__))
+            // x86 doesn't reorder loads with other loads, the compiler must not either
+            asm volatile("" ::: "memory");
+#elif defined(Q_CC_GNU)
+            __sync_synchronize();
+#else
+            QAtomicInt fence;
+            fence.fetchAndAddOrdered(0);
+#endif
+        }
+
+        QAtomicInt m_sequence;
+        T m_value;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_SEQLOCK_H
+// vim: sw=4 ts=4 sts=4 et tw=100
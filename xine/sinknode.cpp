@@ -51,10 +51,13 @@ SinkNode::SinkNode(SinkNodeXT *_xt)
 
 SinkNode::~SinkNode()
 {
+    // the XT object is used by the stream the sink is connected to, drop it in its thread
+    QThread *thread = 0;
     if (m_source) {
+        thread = m_source->streamThread();
         m_source->removeSink(this);
     }
-    KeepReference<0> *keep = new KeepReference<0>;
+    KeepReference<0> *keep = new KeepReference<0>(thread);
     keep->addObject(m_threadSafeObject.data());
     m_threadSafeObject = 0;
     keep->ready();
@@ -62,7 +62,9 @@ SourceNode::~SourceNode()
             s->unsetSource(this);
         }
     }
-    KeepReference<0> *keep = new KeepReference<0>;
+    // a XineStream has to be deleted in the thread it lives in
+    QObject *stream = dynamic_cast<QObject *>(m_threadSafeObject.data());
+    KeepReference<0> *keep = new KeepReference<0>(stream ? stream->thread() : 0);
     keep->addObject(m_threadSafeObject.data());
     m_threadSafeObject = 0;
     keep->ready();
@@ -90,6 +92,20 @@ SinkNode *SourceNode::sinkInterface()
     return 0;
 }
 
+/**
+ * The thread of the XineStream at the root of the graph this node is part of. Returns 0 if the
+ * graph has no XineStream.
+ */
+QThread *SourceNode::streamThread()
+{
+    SourceNode *s = this;
+    while (s->sinkInterface() && s->sinkInterface()->source()) {
+        s = s->sinkInterface()->source();
+    }
+    QObject *root = dynamic_cast<QObject *>(s->m_threadSafeObject.data());
+    return root ? root->thread() : 0;
+}
+
 void SourceNode::upstreamEvent(Event *e)
 {
     Q_ASSERT(e);
@@ -23,6 +23,7 @@
 
 #include <QtCore/QExplicitlySharedDataPointer>
 #include <QtCore/QSet>
+#include <QtCore/QThread>
 #include <xine.h>
 #include "backend.h"
 #include "shareddata.h"
@@ -70,6 +71,7 @@ class SourceNode
         void removeSink(SinkNode *s);
         QSet<SinkNode *> sinks() const;
         virtual SinkNode *sinkInterface();
+        QThread *streamThread();
 
         virtual void upstreamEvent(Event *);
         virtual void downstreamEvent(Event *);
@@ -0,0 +1,98 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_SPSCRINGBUFFER_H
+#define PHONON_XINE_SPSCRINGBUFFER_H
+
+#include <QtCore/QAtomicInt>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * push() may only be called from the producer thread, front(), pop() and isEmpty() only from the
+ * consumer thread. The head index is written by the producer only and the tail index by the
+ * consumer only, so neither side ever needs a lock.
+ *
+ * Both indexes run in [0, 2 * Size) so that a full ring can be told apart from an empty one.
+ * \p Size has to be a power of two.
+ */
+template<typename T, int Size>
+class SpscRingBuffer
+{
+    public:
+        SpscRingBuffer() : m_head(0), m_tail(0) {}
+
+        // producer thread
+        bool push(const T &item)
+        {
+            const int head = m_head;
+            const int tail = m_tail.fetchAndAddAcquire(0);
+            if (((head - tail) & IndexMask) == Size) {
+                return false;
+            }
+            m_items[head & SlotMask] = item;
+            // publish the item only after it has been written completely
+            m_head.fetchAndStoreRelease((head + 1) & IndexMask);
+            return true;
+        }
+
+        // consumer thread
+        bool isEmpty() const
+        {
+            return m_tail == const_cast<QAtomicInt &>(m_head).fetchAndAddAcquire(0);
+        }
+
+        // consumer thread
+        T &front()
+        {
+            Q_ASSERT(!isEmpty());
+            return m_items[m_tail & SlotMask];
+        }
+
+        // consumer thread
+        void pop()
+        {
+            Q_ASSERT(!isEmpty());
+            const int tail = m_tail;
+            // release the item's resources in the consumer thread, before the slot is handed back
+            m_items[tail & SlotMask] = T();
+            m_tail.fetchAndStoreRelease((tail + 1) & IndexMask);
+        }
+
+    private:
+        enum {
+            SlotMask = Size - 1,
+            IndexMask = 2 * Size - 1
+        };
+
+        T m_items[Size];
+        QAtomicInt m_head;
+        QAtomicInt m_tail;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_SPSCRINGBUFFER_H
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,201 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "streamcache.h"
+#include "backend.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QMutexLocker>
+
+#include <cstring>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+StreamCache::StreamCache(const QString &directory, qint64 size)
+    : m_file(QDir(directory).filePath(QLatin1String("phonon-xine-cache-XXXXXX"))),
+    m_map(0),
+    m_lruHead(-1),
+    m_lruTail(-1)
+{
+    const int slots = size / BlockSize;
+    if (slots <= 0) {
+        return;
+    }
+    // the file is sparse, disk space is only used for the blocks that are written
+    if (!m_file.open() || !m_file.resize(static_cast<qint64>(slots) * BlockSize)) {
+        qWarning() << "cannot create the stream cache in" << directory << ":" << m_file.errorString();
+        return;
+    }
+    m_map = m_file.map(0, m_file.size());
+    if (!m_map) {
+        qWarning() << "cannot map the stream cache file:" << m_file.errorString();
+        return;
+    }
+    m_slots.resize(slots);
+    for (int i = 0; i < slots; ++i) {
+        m_freeSlots << i;
+    }
+    debug() << Q_FUNC_INFO << "caching up to" << slots << "blocks in" << m_file.fileName();
+}
+
+StreamCache::~StreamCache()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+// m_mutex must be locked
+void StreamCache::unlink(int slot)
+{
+    Slot &s = m_slots[slot];
+    if (s.prev >= 0) {
+        m_slots[s.prev].next = s.next;
+    } else {
+        m_lruHead = s.next;
+    }
+    if (s.next >= 0) {
+        m_slots[s.next].prev = s.prev;
+    } else {
+        m_lruTail = s.prev;
+    }
+}
+
+// m_mutex must be locked: makes \p slot the most recently used one, it must be in the list already
+void StreamCache::touch(int slot)
+{
+    if (slot == m_lruTail) {
+        return;
+    }
+    unlink(slot);
+    Slot &s = m_slots[slot];
+    s.prev = m_lruTail;
+    s.next = -1;
+    m_slots[m_lruTail].next = slot;
+    m_lruTail = slot;
+}
+
+// m_mutex must be locked: returns a slot that is not in the list
+int StreamCache::takeSlot()
+{
+    if (!m_freeSlots.isEmpty()) {
+        return m_freeSlots.takeLast();
+    }
+    // evict the least recently used block
+    Q_ASSERT(m_lruHead >= 0);
+    const int slot = m_lruHead;
+    m_blocks.remove(m_slots[slot].index);
+    unlink(slot);
+    return slot;
+}
+
+void StreamCache::write(qint64 offset, const QByteArray &data)
+{
+    if (!m_map) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    const char *src = data.constData();
+    int remaining = data.size();
+    while (remaining > 0) {
+        const qint64 index = offset / BlockSize;
+        const int begin = offset % BlockSize;
+        const int len = qMin(remaining, BlockSize - begin);
+        const int end = begin + len;
+
+        const QHash<qint64, int>::ConstIterator it = m_blocks.constFind(index);
+        int slot;
+        if (it == m_blocks.constEnd()) {
+            slot = takeSlot();
+            Slot &s = m_slots[slot];
+            s.index = index;
+            s.begin = begin;
+            s.end = end;
+            s.prev = m_lruTail;
+            s.next = -1;
+            if (m_lruTail >= 0) {
+                m_slots[m_lruTail].next = slot;
+            } else {
+                m_lruHead = slot;
+            }
+            m_lruTail = slot;
+            m_blocks.insert(index, slot);
+        } else {
+            slot = it.value();
+            Slot &s = m_slots[slot];
+            if (end < s.begin || begin > s.end) {
+                // not contiguous with what the block holds: only keep the new range
+                s.begin = begin;
+                s.end = end;
+            } else {
+                s.begin = qMin(s.begin, begin);
+                s.end = qMax(s.end, end);
+            }
+            touch(slot);
+        }
+        memcpy(m_map + static_cast<qint64>(slot) * BlockSize + begin, src, len);
+
+        src += len;
+        offset += len;
+        remaining -= len;
+    }
+}
+
+/**
+ * Returns up to \p maxSize bytes of contiguous data starting at \p offset. The returned data is
+ * empty if \p offset is not cached.
+ */
+QByteArray StreamCache::read(qint64 offset, int maxSize)
+{
+    QByteArray data;
+    if (!m_map) {
+        return data;
+    }
+    QMutexLocker lock(&m_mutex);
+    while (data.size() < maxSize) {
+        const qint64 index = offset / BlockSize;
+        const int begin = offset % BlockSize;
+        const QHash<qint64, int>::ConstIterator it = m_blocks.constFind(index);
+        if (it == m_blocks.constEnd()) {
+            break;
+        }
+        const int slot = it.value();
+        const Slot &s = m_slots[slot];
+        if (begin < s.begin || begin >= s.end) {
+            break;
+        }
+        const int len = qMin(maxSize - data.size(), s.end - begin);
+        data.append(reinterpret_cast<const char *>(m_map) + static_cast<qint64>(slot) * BlockSize + begin, len);
+        touch(slot);
+        offset += len;
+        if (begin + len < BlockSize) {
+            // either maxSize is reached or the block ends before the end of the slot
+            break;
+        }
+    }
+    return data;
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,90 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_STREAMCACHE_H
+#define PHONON_XINE_STREAMCACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QVector>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief Byte range cache for the data of a ByteStream, backed by a memory mapped temporary file.
+ *
+ * The stream is split into blocks of BlockSize bytes. Every block that received data occupies one
+ * slot of the file, when all slots are in use the least recently used block is dropped. Per block
+ * only one contiguous range of valid bytes is tracked.
+ *
+ * write() is called from the thread delivering the data, read() from the xine thread.
+ */
+class StreamCache
+{
+    public:
+        StreamCache(const QString &directory, qint64 size);
+        ~StreamCache();
+
+        bool isValid() const { return m_map != 0; }
+
+        void write(qint64 offset, const QByteArray &data);
+        QByteArray read(qint64 offset, int maxSize);
+
+    private:
+        enum {
+            BlockSize = 64 * 1024
+        };
+        // one per slot of the file, the slots in use form a doubly linked list in the order of
+        // their last use
+        struct Slot
+        {
+            qint64 index;
+            int begin;
+            int end;
+            int prev;
+            int next;
+        };
+        int takeSlot();
+        void unlink(int slot);
+        void touch(int slot);
+
+        QMutex m_mutex;
+        QTemporaryFile m_file;
+        uchar *m_map;
+        // block index -> slot
+        QHash<qint64, int> m_blocks;
+        QVector<Slot> m_slots;
+        QList<int> m_freeSlots;
+        // least and most recently used slot, -1 if no slot is in use
+        int m_lruHead;
+        int m_lruTail;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_STREAMCACHE_H
+// vim: sw=4 ts=4 sts=4 et tw=100
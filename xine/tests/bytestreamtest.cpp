@@ -0,0 +1,256 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+/*
+ * Reads from a ByteStream the way the kbytestream input plugin does, in a thread of its own, while
+ * the StreamInterface is served by the main thread's event loop.
+ */
+
+#include "../backend.h"
+#include "../bytestream.h"
+#include "../mediaobject.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QThread>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+#include <QtGui/QApplication>
+#include <QtTest/QtTest>
+
+#include <phonon/abstractmediastream.h>
+#include <phonon/mediasource.h>
+
+#include <unistd.h>
+
+using Phonon::Xine::Backend;
+using Phonon::Xine::ByteStream;
+using Phonon::Xine::MediaObject;
+
+// ByteStream::SeekTimeout
+static const int SeekTimeout = 10000;
+
+/**
+ * Serves a counting byte pattern in chunks of 4 KB. The answer to the next seek can be delayed.
+ */
+class LateStream : public Phonon::AbstractMediaStream
+{
+    Q_OBJECT
+    public:
+        LateStream(int size)
+            : m_position(0),
+            m_seekDelay(0),
+            m_waiting(false)
+        {
+            m_data.resize(size);
+            for (int i = 0; i < size; ++i) {
+                m_data[i] = static_cast<char>(i * 7);
+            }
+            setStreamSize(size);
+            setStreamSeekable(true);
+        }
+
+        const QByteArray &data() const { return m_data; }
+
+        // the data at the offset of the next seek is only written after \p msec
+        void delayNextSeek(int msec) { m_seekDelay = msec; }
+
+    protected:
+        void reset()
+        {
+            m_position = 0;
+            m_waiting = false;
+        }
+
+        void needData()
+        {
+            if (m_waiting) {
+                return;
+            }
+            if (m_position >= m_data.size()) {
+                endOfData();
+                return;
+            }
+            const QByteArray chunk = m_data.mid(m_position, 4096);
+            m_position += chunk.size();
+            writeData(chunk);
+        }
+
+        void seekStream(qint64 offset)
+        {
+            m_position = offset;
+            if (m_seekDelay > 0) {
+                m_waiting = true;
+                QTimer::singleShot(m_seekDelay, this, SLOT(answerSeek()));
+                m_seekDelay = 0;
+            }
+        }
+
+    private slots:
+        void answerSeek()
+        {
+            m_waiting = false;
+            needData();
+        }
+
+    private:
+        QByteArray m_data;
+        int m_position;
+        int m_seekDelay;
+        bool m_waiting;
+};
+
+/**
+ * Plays the xine thread: seeks and then reads twice, remembering what the reads returned and how
+ * long they took.
+ */
+class Reader : public QThread
+{
+    public:
+        Reader(ByteStream *stream, qint64 offset, int size)
+            : m_stream(stream), m_offset(offset), m_size(size)
+        {
+            for (int i = 0; i < 2; ++i) {
+                result[i] = -1;
+                elapsed[i] = -1;
+            }
+        }
+
+        qint64 result[2];
+        int elapsed[2];
+        QByteArray data[2];
+
+    protected:
+        void run()
+        {
+            m_stream->seekBuffer(m_offset);
+            for (int i = 0; i < 2; ++i) {
+                data[i].resize(m_size);
+                QTime time;
+                time.start();
+                result[i] = m_stream->readFromBuffer(data[i].data(), m_size);
+                elapsed[i] = time.elapsed();
+            }
+        }
+
+    private:
+        ByteStream *const m_stream;
+        const qint64 m_offset;
+        const int m_size;
+};
+
+class ByteStreamTest : public QObject
+{
+    Q_OBJECT
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void lateSeek();
+        void seekAnsweredAfterTimeout();
+
+    private:
+        bool waitFor(Reader *reader, ByteStream *stream, int msec);
+
+        Backend *m_backend;
+        MediaObject *m_mediaObject;
+};
+
+void ByteStreamTest::initTestCase()
+{
+    // the backend reads its settings and writes its caches, keep the user's files out of it
+    const QString home = QDir::temp().filePath(QString::fromLatin1("phononxine-bytestreamtest-%1").arg(getpid()));
+    QDir().mkpath(home);
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(home));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(home));
+
+    m_backend = new Backend;
+    m_mediaObject = new MediaObject(0);
+}
+
+void ByteStreamTest::cleanupTestCase()
+{
+    delete m_mediaObject;
+    delete m_backend;
+}
+
+// runs the event loop, which serves the StreamInterface, until \p reader finished. A reader that
+// is still waiting after \p msec is woken up by stopping \p stream.
+bool ByteStreamTest::waitFor(Reader *reader, ByteStream *stream, int msec)
+{
+    QTime time;
+    time.start();
+    while (!reader->isFinished() && time.elapsed() < msec) {
+        QTest::qWait(50);
+    }
+    const bool finished = reader->isFinished();
+    stream->stop();
+    reader->wait();
+    return finished;
+}
+
+// a StreamInterface answering a seek late, but before the timeout, delays the read
+void ByteStreamTest::lateSeek()
+{
+    LateStream source(1024 * 1024);
+    source.delayNextSeek(1000);
+    ByteStream *stream = new ByteStream(Phonon::MediaSource(&source), m_mediaObject);
+
+    const qint64 offset = 512 * 1024;
+    Reader reader(stream, offset, 100);
+    reader.start();
+    const bool finished = waitFor(&reader, stream, SeekTimeout);
+    delete stream;
+    QVERIFY(finished);
+
+    QCOMPARE(reader.result[0], qint64(100));
+    QVERIFY(reader.elapsed[0] >= 900);
+    QCOMPARE(reader.data[0], source.data().mid(offset, 100));
+    QCOMPARE(reader.result[1], qint64(100));
+    QCOMPARE(reader.data[1], source.data().mid(offset + 100, 100));
+}
+
+// the read waiting for a seek gives up after the timeout, the next one gets the late data
+void ByteStreamTest::seekAnsweredAfterTimeout()
+{
+    LateStream source(1024 * 1024);
+    source.delayNextSeek(SeekTimeout + 1000);
+    ByteStream *stream = new ByteStream(Phonon::MediaSource(&source), m_mediaObject);
+
+    const qint64 offset = 512 * 1024;
+    Reader reader(stream, offset, 100);
+    reader.start();
+    const bool finished = waitFor(&reader, stream, 2 * SeekTimeout);
+    delete stream;
+    QVERIFY(finished);
+
+    QCOMPARE(reader.result[0], qint64(0));
+    QVERIFY(reader.elapsed[0] >= SeekTimeout - 100);
+    // the timeout must not make the following reads return right away
+    QCOMPARE(reader.result[1], qint64(100));
+    QCOMPARE(reader.data[1], source.data().mid(offset, 100));
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+    ByteStreamTest test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "bytestreamtest.moc"
+// vim: sw=4 ts=4 sts=4 et tw=100
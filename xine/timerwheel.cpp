@@ -0,0 +1,295 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "timerwheel.h"
+
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QTimerEvent>
+
+#include <time.h>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+WheelTimer::WheelTimer(QObject *parent)
+    : QObject(parent),
+    m_interval(0),
+    m_singleShot(false),
+    m_expires(0),
+    m_list(0),
+    m_prev(0),
+    m_next(0)
+{
+}
+
+WheelTimer::~WheelTimer()
+{
+    stop();
+}
+
+void WheelTimer::start(int msec)
+{
+    m_interval = msec;
+    start();
+}
+
+void WheelTimer::start()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    TimerWheel *wheel = TimerWheel::instance();
+    wheel->remove(this);
+    wheel->add(this, m_interval);
+}
+
+void WheelTimer::stop()
+{
+    if (m_list) {
+        Q_ASSERT(QThread::currentThread() == thread());
+        TimerWheel::instance()->remove(this);
+    }
+}
+
+// deleted when the thread finishes
+static QThreadStorage<TimerWheel *> s_wheels;
+
+TimerWheel *TimerWheel::instance()
+{
+    if (!s_wheels.hasLocalData()) {
+        s_wheels.setLocalData(new TimerWheel);
+    }
+    return s_wheels.localData();
+}
+
+TimerWheel::TimerWheel()
+    : m_expired(0),
+    m_currentTick(currentTick()),
+    m_scheduledTick(-1),
+    m_timerCount(0),
+    m_advancing(false)
+{
+    for (int level = 0; level < Levels; ++level) {
+        for (int slot = 0; slot < Slots; ++slot) {
+            m_slots[level][slot] = 0;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    // timers that outlive the wheel of their thread never time out
+    for (int level = 0; level < Levels; ++level) {
+        for (int slot = 0; slot < Slots; ++slot) {
+            for (WheelTimer *t = m_slots[level][slot]; t; t = t->m_next) {
+                t->m_list = 0;
+            }
+        }
+    }
+}
+
+qint64 TimerWheel::currentTime()
+{
+    // CLOCK_MONOTONIC does not jump when the wall clock is set
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<qint64>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+qint64 TimerWheel::currentTick()
+{
+    return currentTime() / Granularity;
+}
+
+void TimerWheel::add(WheelTimer *timer, int msec)
+{
+    Q_ASSERT(!timer->m_list);
+    if (m_timerCount == 0 && !m_advancing) {
+        // nothing happened on the wheel for a while, don't walk through all the empty ticks
+        m_currentTick = currentTick();
+    }
+    // round up, a timer must not time out early
+    timer->m_expires = currentTick() + (qMax(0, msec) + Granularity - 1) / Granularity;
+    ++m_timerCount;
+    insert(timer);
+    if (!m_advancing) {
+        reschedule();
+    }
+}
+
+void TimerWheel::remove(WheelTimer *timer)
+{
+    if (!timer->m_list) {
+        return;
+    }
+    if (timer->m_prev) {
+        timer->m_prev->m_next = timer->m_next;
+    } else {
+        *timer->m_list = timer->m_next;
+    }
+    if (timer->m_next) {
+        timer->m_next->m_prev = timer->m_prev;
+    }
+    timer->m_list = 0;
+    timer->m_prev = 0;
+    timer->m_next = 0;
+    if (--m_timerCount == 0) {
+        m_timer.stop();
+        m_scheduledTick = -1;
+    }
+}
+
+void TimerWheel::insert(WheelTimer *timer)
+{
+    const qint64 expires = qMax(timer->m_expires, m_currentTick);
+    const qint64 delta = expires - m_currentTick;
+    WheelTimer **list;
+    if (delta < Slots) {
+        list = &m_slots[0][expires & SlotMask];
+    } else {
+        int level = 1;
+        while (level < Levels - 1 && delta >= (Q_INT64_C(1) << (SlotBits * (level + 1)))) {
+            ++level;
+        }
+        // timers beyond the range of the last level wait in its furthest slot and are put in
+        // place when that slot is cascaded
+        const qint64 maxDelta = (Q_INT64_C(1) << (SlotBits * Levels)) - 1;
+        const qint64 slotTick = m_currentTick + qMin(delta, maxDelta);
+        list = &m_slots[level][(slotTick >> (SlotBits * level)) & SlotMask];
+    }
+    timer->m_list = list;
+    timer->m_prev = 0;
+    timer->m_next = *list;
+    if (*list) {
+        (*list)->m_prev = timer;
+    }
+    *list = timer;
+}
+
+// distributes the current slot of \p level over the levels below
+void TimerWheel::cascade(int level)
+{
+    WheelTimer **list = &m_slots[level][(m_currentTick >> (SlotBits * level)) & SlotMask];
+    WheelTimer *timer = *list;
+    *list = 0;
+    while (timer) {
+        WheelTimer *next = timer->m_next;
+        insert(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::advanceTo(qint64 tick)
+{
+    m_advancing = true;
+    while (m_currentTick <= tick && m_timerCount > 0) {
+        for (int level = 1; level < Levels; ++level) {
+            if (m_currentTick & ((Q_INT64_C(1) << (SlotBits * level)) - 1)) {
+                break;
+            }
+            cascade(level);
+        }
+        WheelTimer **list = &m_slots[0][m_currentTick & SlotMask];
+        m_expired = *list;
+        *list = 0;
+        for (WheelTimer *t = m_expired; t; t = t->m_next) {
+            t->m_list = &m_expired;
+        }
+        ++m_currentTick;
+        // a timeout() handler may stop or delete any of the expired timers
+        while (m_expired) {
+            WheelTimer *timer = m_expired;
+            remove(timer);
+            if (!timer->m_singleShot) {
+                add(timer, timer->m_interval);
+            }
+            emit timer->timeout();
+        }
+    }
+    m_advancing = false;
+}
+
+// the first tick at which a timer expires or a slot has to be cascaded, -1 if there is none
+qint64 TimerWheel::nextTick() const
+{
+    qint64 next = -1;
+    for (int k = 0; k < Slots; ++k) {
+        if (m_slots[0][(m_currentTick + k) & SlotMask]) {
+            next = m_currentTick + k;
+            break;
+        }
+    }
+    for (int level = 1; level < Levels; ++level) {
+        const int shift = SlotBits * level;
+        for (int k = 0; k <= Slots; ++k) {
+            const qint64 block = (m_currentTick >> shift) + k;
+            const qint64 tick = block << shift;
+            if (tick < m_currentTick) {
+                continue;
+            }
+            if (next >= 0 && tick >= next) {
+                break;
+            }
+            if (m_slots[level][block & SlotMask]) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void TimerWheel::reschedule()
+{
+    const qint64 next = nextTick();
+    if (next < 0) {
+        m_timer.stop();
+        m_scheduledTick = -1;
+        return;
+    }
+    if (next == m_scheduledTick && m_timer.isActive()) {
+        return;
+    }
+    m_scheduledTick = next;
+    m_timer.start(static_cast<int>(qMax(Q_INT64_C(0), next * Granularity - currentTime())), this);
+}
+
+void TimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+    if (m_advancing) {
+        // a timeout() handler runs an event loop, the outer advanceTo takes care of everything
+        return;
+    }
+    // QBasicTimer is periodic, reschedule starts it for the next tick again
+    m_timer.stop();
+    m_scheduledTick = -1;
+    advanceTo(currentTick());
+    reschedule();
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+#include "timerwheel.moc"
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,130 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_TIMERWHEEL_H
+#define PHONON_XINE_TIMERWHEEL_H
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QObject>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+class TimerWheel;
+
+/**
+ * \brief A timer with the interface of QTimer that is scheduled on the TimerWheel of its thread.
+ *
+ * A WheelTimer has to be started and stopped from the thread it lives in.
+ */
+class WheelTimer : public QObject
+{
+    friend class TimerWheel;
+    Q_OBJECT
+    public:
+        WheelTimer(QObject *parent = 0);
+        ~WheelTimer();
+
+        bool isActive() const { return m_list != 0; }
+        int interval() const { return m_interval; }
+        void setInterval(int msec) { m_interval = msec; }
+        bool isSingleShot() const { return m_singleShot; }
+        void setSingleShot(bool singleShot) { m_singleShot = singleShot; }
+
+    public slots:
+        void start(int msec);
+        void start();
+        void stop();
+
+    signals:
+        void timeout();
+
+    private:
+        int m_interval;
+        bool m_singleShot;
+        // the tick of the wheel at which the timer expires
+        qint64 m_expires;
+        // the list of the wheel the timer is in, 0 if it is not active
+        WheelTimer **m_list;
+        WheelTimer *m_prev;
+        WheelTimer *m_next;
+};
+
+/**
+ * \brief Schedules all WheelTimers of one thread with a single timer.
+ *
+ * The time is divided into ticks of Granularity milliseconds. Timers that expire in the same tick
+ * time out together, so a thread running many streams wakes up once for all ticks and deadlines
+ * that are due at the same time instead of once per QTimer.
+ *
+ * The wheel is hierarchical: the first level has one slot per tick for the next Slots ticks, every
+ * further level has slots that are Slots times longer. When the first level wraps around, the next
+ * slot of the second level is distributed over it, and so on. Adding and removing a timer is O(1)
+ * and the thread only wakes up when the next non-empty slot is due.
+ */
+class TimerWheel : public QObject
+{
+    public:
+        // the wheel of the current thread
+        static TimerWheel *instance();
+
+        TimerWheel();
+        ~TimerWheel();
+
+        void add(WheelTimer *timer, int msec);
+        void remove(WheelTimer *timer);
+
+    protected:
+        void timerEvent(QTimerEvent *event);
+
+    private:
+        enum {
+            Granularity = 10,
+            SlotBits = 6,
+            Slots = 1 << SlotBits,
+            SlotMask = Slots - 1,
+            Levels = 4
+        };
+        static qint64 currentTime();
+        static qint64 currentTick();
+        void insert(WheelTimer *timer);
+        void cascade(int level);
+        void advanceTo(qint64 tick);
+        qint64 nextTick() const;
+        void reschedule();
+
+        WheelTimer *m_slots[Levels][Slots];
+        // the timers of the tick that is being processed
+        WheelTimer *m_expired;
+        // the next tick that is processed
+        qint64 m_currentTick;
+        // the tick m_timer wakes up for
+        qint64 m_scheduledTick;
+        int m_timerCount;
+        bool m_advancing;
+        QBasicTimer m_timer;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_TIMERWHEEL_H
+// vim: sw=4 ts=4 sts=4 et tw=100
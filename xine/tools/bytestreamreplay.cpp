@@ -0,0 +1,316 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+/*
+ * Replays a ByteStream trace recorded with PHONON_XINE_TRACE_DIR into a Phonon::MediaObject.
+ *
+ * usage: phononxine-replay [--fast] <trace file>
+ *
+ * By default the data is delivered at the recorded pace. With --fast it is written as fast as the
+ * backend asks for it.
+ */
+
+#include "../bytestreamtrace.h"
+
+#include <QtCore/QStringList>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
+#include <QtCore/QtDebug>
+#include <QtGui/QApplication>
+
+#include <phonon/abstractmediastream.h>
+#include <phonon/audiooutput.h>
+#include <phonon/mediaobject.h>
+#include <phonon/path.h>
+
+#include <cstdio>
+
+using Phonon::Xine::ByteStreamTraceReader;
+using Phonon::Xine::ByteStreamTraceRecord;
+
+class TraceStream : public Phonon::AbstractMediaStream
+{
+    Q_OBJECT
+    public:
+        TraceStream(const QString &fileName, bool paced, QObject *parent = 0);
+
+        bool isValid() const { return m_valid; }
+
+    protected:
+        void reset();
+        void needData();
+        void enoughData();
+        void seekStream(qint64 offset);
+
+    private slots:
+        void deliver();
+
+    private:
+        bool rewind();
+        bool next();
+        bool findSeek(qint64 offset);
+
+        const QString m_fileName;
+        ByteStreamTraceReader m_reader;
+        ByteStreamTraceRecord m_record;
+        QTimer m_timer;
+        // time since the (re)start of the replay, compared to the recorded times
+        QTime m_clock;
+        quint32 m_timeBase;
+        // the number of records read since the start of the trace
+        int m_index;
+        bool m_valid : 1;
+        bool m_paced : 1;
+        bool m_wanted : 1;
+        // the current record is a seek the backend has not asked for yet
+        bool m_waitingForSeek : 1;
+        bool m_atEnd : 1;
+};
+
+TraceStream::TraceStream(const QString &fileName, bool paced, QObject *parent)
+    : Phonon::AbstractMediaStream(parent),
+    m_fileName(fileName),
+    m_timeBase(0),
+    m_index(0),
+    m_valid(false),
+    m_paced(paced),
+    m_wanted(false),
+    m_waitingForSeek(false),
+    m_atEnd(false)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(deliver()));
+    m_valid = rewind();
+}
+
+// starts reading the trace from the beginning
+bool TraceStream::rewind()
+{
+    if (!m_reader.open(m_fileName)) {
+        return false;
+    }
+    m_index = 0;
+    m_atEnd = false;
+    m_waitingForSeek = false;
+    m_timeBase = 0;
+    m_clock.start();
+    return next();
+}
+
+bool TraceStream::next()
+{
+    if (!m_reader.readRecord(&m_record)) {
+        m_atEnd = true;
+        return false;
+    }
+    ++m_index;
+    return true;
+}
+
+// continues after the recorded seek to offset, searching from the current record on first
+bool TraceStream::findSeek(qint64 offset)
+{
+    const int start = m_index;
+    do {
+        if (m_record.type == ByteStreamTraceRecord::Seek && m_record.value == offset) {
+            return true;
+        }
+    } while (next());
+
+    // the seek happened earlier in the recording
+    rewind();
+    while (m_index < start) {
+        if (m_record.type == ByteStreamTraceRecord::Seek && m_record.value == offset) {
+            return true;
+        }
+        if (!next()) {
+            break;
+        }
+    }
+    return false;
+}
+
+void TraceStream::reset()
+{
+    rewind();
+    m_wanted = true;
+    deliver();
+}
+
+void TraceStream::needData()
+{
+    m_wanted = true;
+    if (!m_timer.isActive()) {
+        m_timer.start(0);
+    }
+}
+
+void TraceStream::enoughData()
+{
+    m_wanted = false;
+}
+
+void TraceStream::seekStream(qint64 offset)
+{
+    if ((m_waitingForSeek && m_record.type == ByteStreamTraceRecord::Seek
+                && m_record.value == offset) || (offset != 0 && findSeek(offset))) {
+        // the recorded pace continues from the seek
+        m_timeBase = m_record.time;
+        m_clock.restart();
+        m_waitingForSeek = false;
+        next();
+    } else if (offset == 0) {
+        rewind();
+    } else {
+        qWarning() << "the trace has no data at" << offset;
+        endOfData();
+        m_atEnd = true;
+        return;
+    }
+    m_wanted = true;
+    m_timer.start(0);
+}
+
+void TraceStream::deliver()
+{
+    // don't block the event loop for too long in fast mode
+    int budget = 64;
+    while (!m_atEnd && !m_waitingForSeek && budget-- > 0) {
+        switch (m_record.type) {
+        case ByteStreamTraceRecord::Data:
+            if (m_paced) {
+                const qint64 due = qint64(m_record.time) - m_timeBase - m_clock.elapsed();
+                if (due > 0) {
+                    m_timer.start(due);
+                    return;
+                }
+            } else if (!m_wanted) {
+                return;
+            }
+            writeData(m_record.data);
+            break;
+        case ByteStreamTraceRecord::StreamSize:
+            setStreamSize(m_record.value);
+            break;
+        case ByteStreamTraceRecord::Seekable:
+            setStreamSeekable(m_record.value);
+            break;
+        case ByteStreamTraceRecord::EndOfData:
+            endOfData();
+            break;
+        case ByteStreamTraceRecord::Seek:
+            // the data after the seek is only valid once the backend seeks there
+            m_waitingForSeek = true;
+            return;
+        case ByteStreamTraceRecord::Reset:
+            if (m_index > 1) {
+                // the data after a reset starts from the beginning again, the backend calls reset()
+                m_waitingForSeek = true;
+                return;
+            }
+            break;
+        case ByteStreamTraceRecord::NeedData:
+        case ByteStreamTraceRecord::EnoughData:
+        case ByteStreamTraceRecord::Invalid:
+            break;
+        }
+        next();
+    }
+    if (!m_atEnd && !m_waitingForSeek && (m_paced || m_wanted)) {
+        m_timer.start(0);
+    }
+}
+
+class Player : public QObject
+{
+    Q_OBJECT
+    public:
+        Player(TraceStream *stream);
+
+    private slots:
+        void stateChanged(Phonon::State newstate, Phonon::State oldstate);
+        void finished();
+
+    private:
+        Phonon::MediaObject m_media;
+        Phonon::AudioOutput m_output;
+        QTime m_time;
+        int m_stalls;
+        int m_stallTime;
+        QTime m_stallTimer;
+};
+
+Player::Player(TraceStream *stream)
+    : m_output(Phonon::MusicCategory),
+    m_stalls(0),
+    m_stallTime(0)
+{
+    Phonon::createPath(&m_media, &m_output);
+    connect(&m_media, SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+            SLOT(stateChanged(Phonon::State, Phonon::State)));
+    connect(&m_media, SIGNAL(finished()), SLOT(finished()));
+    m_media.setCurrentSource(Phonon::MediaSource(stream));
+    m_time.start();
+    m_media.play();
+}
+
+void Player::stateChanged(Phonon::State newstate, Phonon::State oldstate)
+{
+    if (newstate == Phonon::BufferingState && oldstate == Phonon::PlayingState) {
+        ++m_stalls;
+        m_stallTimer.start();
+    } else if (oldstate == Phonon::BufferingState && m_stallTimer.isValid()) {
+        m_stallTime += m_stallTimer.elapsed();
+        m_stallTimer = QTime();
+    }
+    if (newstate == Phonon::ErrorState) {
+        fprintf(stderr, "error: %s\n", qPrintable(m_media.errorString()));
+        QCoreApplication::exit(1);
+    }
+}
+
+void Player::finished()
+{
+    printf("finished after %d ms, %d stalls (%d ms)\n", m_time.elapsed(), m_stalls, m_stallTime);
+    QCoreApplication::quit();
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+    app.setApplicationName(QLatin1String("phononxine-replay"));
+
+    QStringList args = app.arguments();
+    args.removeFirst();
+    const bool fast = args.removeAll(QLatin1String("--fast")) > 0;
+    if (args.count() != 1) {
+        fprintf(stderr, "usage: phononxine-replay [--fast] <trace file>\n");
+        return 2;
+    }
+
+    TraceStream stream(args.first(), !fast);
+    if (!stream.isValid()) {
+        return 1;
+    }
+    Player player(&stream);
+    return app.exec();
+}
+
+#include "bytestreamreplay.moc"
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,412 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+/*
+ * Measures the latencies of starting playback with the xine backend:
+ *
+ *   backend     loading the plugin, which constructs the Backend
+ *   ready       until an AudioDataOutput could be created, which needs an initialized engine
+ *   mediaobject creating a MediaObject, which waits for XineThread::newStream
+ *   open        from setSource until the MediaObject reaches StoppedState, i.e. xine_open is done
+ *   firstsound  from play() until the first audio buffer reaches the output port
+ *
+ * usage: phononxine-benchmark [--runs N] [--plugin <phonon_xine module>] [<audio file>]
+ *
+ * Without an audio file a short WAV file is generated and played. Every run is a process of its
+ * own, so the backend is constructed from scratch each time. The audio goes through an
+ * AudioDataOutput, which counts the frames and plays to the "none" driver, so no sound device is
+ * needed and the benchmark can run as a test. The plugin catalog and the meta data cache in $XDG_CACHE_HOME are
+ * written by the first run and used by the following ones, point XDG_CACHE_HOME to an empty
+ * directory to measure a cold start.
+ */
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QMap>
+#include <QtCore/QPluginLoader>
+#include <QtCore/QProcess>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/QtAlgorithms>
+#include <QtGui/QApplication>
+
+#include <phonon/audiodataoutput.h>
+#include <phonon/backendinterface.h>
+#include <phonon/mediaobjectinterface.h>
+#include <phonon/mediasource.h>
+#include <phonon/phononnamespace.h>
+
+#include <cmath>
+#include <cstdio>
+#include <time.h>
+#include <unistd.h>
+
+static const char *const metricNames[] = { "backend", "ready", "mediaobject", "open", "firstsound" };
+enum { MetricCount = 5 };
+
+// how long a single step may take before the run is given up
+static const int StepTimeout = 30000;
+
+// microseconds
+static qint64 monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<qint64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Writes \p seconds of a 440 Hz sine wave as 16 bit stereo PCM at 44.1 kHz to a WAV file.
+ */
+static bool writeWavFile(const QString &fileName, int seconds)
+{
+    enum { SampleRate = 44100, Channels = 2, BytesPerSample = 2 };
+    const quint32 dataSize = seconds * SampleRate * Channels * BytesPerSample;
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData("RIFF", 4);
+    stream << static_cast<quint32>(36 + dataSize);
+    stream.writeRawData("WAVEfmt ", 8);
+    stream << static_cast<quint32>(16) << static_cast<quint16>(1) << static_cast<quint16>(Channels)
+        << static_cast<quint32>(SampleRate)
+        << static_cast<quint32>(SampleRate * Channels * BytesPerSample)
+        << static_cast<quint16>(Channels * BytesPerSample)
+        << static_cast<quint16>(8 * BytesPerSample);
+    stream.writeRawData("data", 4);
+    stream << dataSize;
+    for (int i = 0; i < seconds * SampleRate; ++i) {
+        const qint16 sample = static_cast<qint16>(8000 * std::sin(2 * M_PI * 440 * i / SampleRate));
+        stream << sample << sample;
+    }
+    file.close();
+    return stream.status() == QDataStream::Ok && file.error() == QFile::NoError;
+}
+
+/**
+ * Test sink: counts the frames the AudioDataOutput delivers. The slot is called directly from the
+ * xine thread that writes to the output port.
+ */
+class FrameCounter : public QObject
+{
+    Q_OBJECT
+    public:
+        FrameCounter() : m_firstFrameTime(0) {}
+
+        qint64 firstFrameTime() const { return m_firstFrameTime; }
+        int frames() const { return m_frames; }
+
+    signals:
+        void firstFrame();
+
+    public slots:
+        void countFrames(const QMap<Phonon::AudioDataOutput::Channel, QVector<qint16> > &data)
+        {
+            const int frames = data.value(Phonon::AudioDataOutput::LeftChannel).size();
+            if (m_frames.fetchAndAddOrdered(frames) == 0 && frames > 0) {
+                m_firstFrameTime = monotonicTime();
+                // the main thread waits in an event loop
+                QMetaObject::invokeMethod(this, "firstFrame", Qt::QueuedConnection);
+            }
+        }
+
+    private:
+        QAtomicInt m_frames;
+        qint64 m_firstFrameTime;
+};
+
+/**
+ * Returns from wait() when the watched MediaObject reached the state given to expect(), or failed.
+ */
+class StateWaiter : public QObject
+{
+    Q_OBJECT
+    public:
+        StateWaiter(QObject *mediaObject)
+            : m_wanted(Phonon::StoppedState), m_reached(false)
+        {
+            connect(mediaObject, SIGNAL(stateChanged(Phonon::State, Phonon::State)),
+                    SLOT(stateChanged(Phonon::State)));
+        }
+
+        // to be called before the action that causes the state change
+        void expect(Phonon::State state)
+        {
+            m_wanted = state;
+            m_reached = false;
+        }
+
+        bool wait()
+        {
+            if (!m_reached) {
+                QTimer::singleShot(StepTimeout, &m_loop, SLOT(quit()));
+                m_loop.exec();
+            }
+            return m_reached;
+        }
+
+    private slots:
+        void stateChanged(Phonon::State state)
+        {
+            if (state == m_wanted) {
+                m_reached = true;
+                m_loop.quit();
+            } else if (state == Phonon::ErrorState) {
+                m_loop.quit();
+            }
+        }
+
+    private:
+        QEventLoop m_loop;
+        Phonon::State m_wanted;
+        bool m_reached;
+};
+
+/**
+ * Disconnects and deletes the nodes created by measure(), the way the frontend does.
+ */
+static void deleteNodes(Phonon::BackendInterface *backend, QObject *mediaObject, QObject *sink, bool connected)
+{
+    if (connected) {
+        QSet<QObject *> nodes;
+        nodes << mediaObject << sink;
+        backend->startConnectionChange(nodes);
+        backend->disconnectNodes(mediaObject, sink);
+        backend->endConnectionChange(nodes);
+    }
+    delete mediaObject;
+    delete sink;
+}
+
+/**
+ * Measures the latencies after loading the backend, see above. Every object created here is
+ * deleted before it returns.
+ */
+static bool measure(Phonon::BackendInterface *backend, const QString &fileName, qint64 *results)
+{
+    qint64 start = monotonicTime();
+    QObject *sink = backend->createObject(Phonon::BackendInterface::AudioDataOutputClass, 0);
+    results[1] = monotonicTime() - start;
+
+    start = monotonicTime();
+    QObject *mediaObject = backend->createObject(Phonon::BackendInterface::MediaObjectClass, 0);
+    results[2] = monotonicTime() - start;
+    Phonon::MediaObjectInterface *player = qobject_cast<Phonon::MediaObjectInterface *>(mediaObject);
+    if (!sink || !player) {
+        fprintf(stderr, "the backend did not create a MediaObject and an AudioDataOutput\n");
+        deleteNodes(backend, mediaObject, sink, false);
+        return false;
+    }
+
+    // deleted after the sink, which calls it from the xine thread
+    FrameCounter counter;
+    QMetaObject::invokeMethod(sink, "setDataSize", Q_ARG(int, 512));
+    QObject::connect(sink, SIGNAL(dataReady(const QMap<Phonon::AudioDataOutput::Channel, QVector<qint16> > &)),
+            &counter, SLOT(countFrames(const QMap<Phonon::AudioDataOutput::Channel, QVector<qint16> > &)),
+            Qt::DirectConnection);
+    QSet<QObject *> nodes;
+    nodes << mediaObject << sink;
+    backend->startConnectionChange(nodes);
+    const bool connected = backend->connectNodes(mediaObject, sink);
+    backend->endConnectionChange(nodes);
+    if (!connected) {
+        fprintf(stderr, "cannot connect the MediaObject to the AudioDataOutput\n");
+        deleteNodes(backend, mediaObject, sink, false);
+        return false;
+    }
+
+    bool ok = false;
+    StateWaiter waiter(mediaObject);
+    waiter.expect(Phonon::StoppedState);
+    start = monotonicTime();
+    player->setSource(Phonon::MediaSource(fileName));
+    if (!waiter.wait()) {
+        fprintf(stderr, "cannot open %s: %s\n", qPrintable(fileName), qPrintable(player->errorString()));
+    } else {
+        results[3] = monotonicTime() - start;
+
+        QEventLoop loop;
+        QObject::connect(&counter, SIGNAL(firstFrame()), &loop, SLOT(quit()));
+        QTimer::singleShot(StepTimeout, &loop, SLOT(quit()));
+        start = monotonicTime();
+        player->play();
+        loop.exec();
+        if (counter.frames() == 0) {
+            fprintf(stderr, "no audio reached the output port\n");
+        } else {
+            results[4] = counter.firstFrameTime() - start;
+            ok = true;
+        }
+    }
+
+    player->stop();
+    deleteNodes(backend, mediaObject, sink, true);
+    return ok;
+}
+
+/**
+ * One run in this process. Prints the latencies in microseconds as one line to stdout, once the
+ * backend was deleted and the plugin unloaded without errors.
+ */
+static int runOnce(const QString &pluginPath, const QString &fileName)
+{
+    qint64 results[MetricCount];
+
+    QPluginLoader loader(pluginPath);
+    const qint64 start = monotonicTime();
+    QObject *backendObject = loader.instance();
+    results[0] = monotonicTime() - start;
+    Phonon::BackendInterface *backend = qobject_cast<Phonon::BackendInterface *>(backendObject);
+    if (!backend) {
+        fprintf(stderr, "cannot load %s: %s\n", qPrintable(pluginPath), qPrintable(loader.errorString()));
+        return 1;
+    }
+
+    const bool ok = measure(backend, fileName, results);
+
+    // the backend stops its xine threads, the plugin code must stay loaded until they are gone
+    delete backendObject;
+    if (!loader.unload()) {
+        fprintf(stderr, "cannot unload %s: %s\n", qPrintable(pluginPath), qPrintable(loader.errorString()));
+        return 1;
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    for (int i = 0; i < MetricCount; ++i) {
+        printf("%s%lld", i ? " " : "", static_cast<long long>(results[i]));
+    }
+    printf("\n");
+    fflush(stdout);
+    return 0;
+}
+
+static void printStatistics(const char *name, QList<qint64> values)
+{
+    qSort(values);
+    double sum = 0.0;
+    foreach (qint64 value, values) {
+        sum += value;
+    }
+    const double mean = sum / values.size();
+    double variance = 0.0;
+    foreach (qint64 value, values) {
+        variance += (value - mean) * (value - mean);
+    }
+    const double stddev = values.size() > 1 ? std::sqrt(variance / (values.size() - 1)) : 0.0;
+    const int n = values.size();
+    const double median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    printf("%-12s %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, values.first() / 1000.0,
+            median / 1000.0, mean / 1000.0, values.last() / 1000.0, stddev / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv, false);
+    app.setApplicationName(QLatin1String("phononxine-benchmark"));
+
+    QStringList args = app.arguments();
+    args.removeFirst();
+    const bool single = args.removeAll(QLatin1String("--single")) > 0;
+    int runs = 10;
+    QString pluginPath = QLatin1String(PHONON_XINE_PLUGIN_PATH);
+    bool ok = true;
+    for (int i = 0; ok && i < args.count() - 1; ++i) {
+        if (args[i] == QLatin1String("--runs")) {
+            runs = args[i + 1].toInt(&ok);
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            --i;
+        } else if (args[i] == QLatin1String("--plugin")) {
+            pluginPath = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            --i;
+        }
+    }
+    if (!ok || runs <= 0 || args.count() > 1 || (single && args.isEmpty())) {
+        fprintf(stderr, "usage: phononxine-benchmark [--runs N] [--plugin <phonon_xine module>] [<audio file>]\n");
+        return 2;
+    }
+
+    if (single) {
+        return runOnce(pluginPath, args.first());
+    }
+
+    QString fileName;
+    QString generatedFileName;
+    if (args.isEmpty()) {
+        generatedFileName = QDir::temp().filePath(QString::fromLatin1("phononxine-benchmark-%1.wav").arg(getpid()));
+        if (!writeWavFile(generatedFileName, 2)) {
+            fprintf(stderr, "cannot write %s\n", qPrintable(generatedFileName));
+            QFile::remove(generatedFileName);
+            return 1;
+        }
+        fileName = generatedFileName;
+    } else {
+        fileName = args.first();
+    }
+
+    QList<qint64> values[MetricCount];
+    for (int run = 0; run < runs; ++run) {
+        QProcess process;
+        process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process.start(app.applicationFilePath(), QStringList() << QLatin1String("--single")
+                << QLatin1String("--plugin") << pluginPath << fileName);
+        // a run that crashes or fails while shutting the backend down fails the benchmark, too
+        const bool finished = process.waitForFinished(MetricCount * StepTimeout);
+        const QStringList fields = QString::fromLatin1(process.readAllStandardOutput()).simplified()
+            .split(QLatin1Char(' '), QString::SkipEmptyParts);
+        if (!finished || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0
+                || fields.count() != MetricCount) {
+            if (!finished) {
+                process.kill();
+                process.waitForFinished();
+            }
+            fprintf(stderr, "run %d failed\n", run + 1);
+            if (!generatedFileName.isEmpty()) {
+                QFile::remove(generatedFileName);
+            }
+            return 1;
+        }
+        for (int i = 0; i < MetricCount; ++i) {
+            values[i] << fields[i].toLongLong();
+        }
+    }
+    if (!generatedFileName.isEmpty()) {
+        QFile::remove(generatedFileName);
+    }
+
+    printf("%d runs, milliseconds\n", runs);
+    printf("%-12s %10s %10s %10s %10s %10s\n", "", "min", "median", "mean", "max", "stddev");
+    for (int i = 0; i < MetricCount; ++i) {
+        printStatistics(metricNames[i], values[i]);
+    }
+    return 0;
+}
+
+#include "latencybenchmark.moc"
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -200,7 +200,7 @@ void VideoDataOutput::setFrontendObject(Experimental::AbstractVideoDataOutput *x
         if (src) {
             QList<WireCall> wireCall;
             wireCall << WireCall(src, this);
-            QCoreApplication::postEvent(XineThread::instance(), new RewireEvent(wireCall, QList<WireCall>()));
+            XineThread::postRewire(wireCall, QList<WireCall>());
         }
     }
 }
@@ -215,7 +215,7 @@ void VideoDataOutput::aboutToChangeXineEngine()
         xt2->m_needNewPort = false;
         xt->m_needNewPort = true;
         xt->m_videoPort = 0;
-        KeepReference<> *keep = new KeepReference<>;
+        KeepReference<> *keep = new KeepReference<>(source() ? source()->streamThread() : 0);
         keep->addObject(xt2);
         keep->ready();
     }
@@ -656,7 +656,7 @@ void VideoWidget::aboutToChangeXineEngine()
         xt2->m_xcbConnection = xt->m_xcbConnection;
         xt->m_videoPort = 0;
         xt->m_xcbConnection = 0;
-        KeepReference<> *keep = new KeepReference<>;
+        KeepReference<> *keep = new KeepReference<>(source() ? source()->streamThread() : 0);
         keep->addObject(xt2);
         keep->ready();
     }
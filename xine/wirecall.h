@@ -24,6 +24,8 @@
 
 #include "sinknode.h"
 #include "sourcenode.h"
+#include <QtCore/QObject>
+#include <QtCore/QThread>
 
 namespace Phonon
 {
@@ -69,6 +71,15 @@ class WireCall
             return source == rhs.source && sink == rhs.sink;
         }
 
+        /**
+         * The thread of the XineStream at the root of the graph this wire is part of, the rewiring
+         * has to happen there. Returns 0 if the graph has no XineStream.
+         */
+        QThread *thread() const
+        {
+            return src ? src->streamThread() : 0;
+        }
+
         void addReferenceTo(const QList<QExplicitlySharedDataPointer<SharedData> > &data)
         {
             extraReferences += data;
@@ -44,7 +44,8 @@ namespace Xine
 {
 
 XineEngineData::XineEngineData()
-    : m_xine(xine_new())
+    : m_xine(xine_new()),
+    m_streamPool(0)
 {
     const QByteArray phonon_xine_verbosity(getenv("PHONON_XINE_VERBOSITY"));
     debug() << Q_FUNC_INFO << "setting xine verbosity to" << phonon_xine_verbosity.toInt();
@@ -68,10 +69,12 @@ XineEngineData::XineEngineData()
         debug() << "save xine config to" << configfile.constData();
         xine_config_save(m_xine, configfile.constData());
     }
+    m_streamPool = new XineStreamPool(m_xine);
 }
 
 XineEngineData::~XineEngineData()
 {
+    delete m_streamPool;
     if (m_xine) {
         xine_exit(m_xine);
     }
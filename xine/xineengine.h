@@ -27,6 +27,8 @@
 
 #include <xine.h>
 
+#include "xinestreampool.h"
+
 namespace Phonon
 {
 namespace Xine
@@ -38,6 +40,7 @@ struct XineEngineData : public QSharedData
     ~XineEngineData();
 
     xine_t *m_xine;
+    XineStreamPool *m_streamPool;
 };
 
 class XineEngine
@@ -48,6 +51,7 @@ class XineEngine
         inline bool operator==(const XineEngine &rhs) const { return d == rhs.d; }
         inline bool operator!=(const XineEngine &rhs) const { return d != rhs.d; }
         void create();
+        inline XineStreamPool *streamPool() const { Q_ASSERT(d.data()); return d->m_streamPool; }
 
     private:
         QExplicitlySharedDataPointer<XineEngineData> d;
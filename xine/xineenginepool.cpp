@@ -0,0 +1,175 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "xineenginepool.h"
+#include "backend.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+class XineEnginePool::Warmer : public QThread
+{
+    public:
+        Warmer(XineEnginePool *pool) : m_pool(pool) {}
+
+    protected:
+        void run() { m_pool->warm(); }
+
+    private:
+        XineEnginePool *const m_pool;
+};
+
+XineEnginePool::XineEnginePool(int minSize, int maxSize)
+    : m_expected(0),
+    m_warming(0),
+    m_warmer(0),
+    m_minSize(qMax(0, minSize)),
+    m_maxSize(qMax(m_minSize, maxSize)),
+    m_quit(false),
+    m_hits(0),
+    m_misses(0),
+    m_warmed(0),
+    m_disposed(0)
+{
+}
+
+XineEnginePool::~XineEnginePool()
+{
+    if (m_warmer) {
+        m_mutex.lock();
+        m_quit = true;
+        m_needEngines.wakeAll();
+        m_mutex.unlock();
+        // an engine that is being created is finished first
+        m_warmer->wait();
+        delete m_warmer;
+    }
+}
+
+// warmer thread
+void XineEnginePool::warm()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_quit) {
+        if (m_freeEngines.size() + m_expected + m_warming >= m_minSize) {
+            m_needEngines.wait(&m_mutex);
+            continue;
+        }
+        ++m_warming;
+        locker.unlock();
+        XineEngine engine;
+        engine.create();
+        locker.relock();
+        --m_warming;
+        ++m_warmed;
+        m_freeEngines << engine;
+        m_engineAdded.wakeAll();
+    }
+}
+
+/**
+ * Returns a free engine. If none is left but one was announced with expectEngine(), that one is
+ * waited for. Only otherwise a new engine is created in the calling thread, also when the Warmer
+ * is creating one: waiting for a low priority thread could take longer than creating the engine.
+ */
+// any thread
+XineEngine XineEnginePool::acquire()
+{
+    XineEngine engine;
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_freeEngines.isEmpty() && m_expected > 0) {
+            m_engineAdded.wait(&m_mutex);
+        }
+        if (!m_freeEngines.isEmpty()) {
+            ++m_hits;
+            engine = m_freeEngines.takeLast();
+        } else {
+            ++m_misses;
+        }
+        if (m_freeEngines.size() + m_expected + m_warming < m_minSize) {
+            if (!m_warmer) {
+                // started with the first stream, processes that never play don't pay for it
+                m_warmer = new Warmer(this);
+                m_warmer->start(QThread::LowPriority);
+            }
+            m_needEngines.wakeOne();
+        }
+    }
+    if (!engine) {
+        debug() << Q_FUNC_INFO << "no free engine, creating one";
+        engine.create();
+    }
+    return engine;
+}
+
+// any thread
+void XineEnginePool::release(const XineEngine &engine)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_freeEngines.size() < m_maxSize) {
+        m_freeEngines << engine;
+        return;
+    }
+    ++m_disposed;
+    // the engine is disposed when the caller drops its reference, after the lock is released
+}
+
+/**
+ * Announces an engine that the caller creates and passes to addExpectedEngine() later. Until
+ * then acquire() waits for it instead of creating another one.
+ */
+// any thread
+void XineEnginePool::expectEngine()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_expected;
+}
+
+/**
+ * Adds the engine announced with expectEngine() and wakes the threads waiting for it.
+ */
+// any thread
+void XineEnginePool::addExpectedEngine(const XineEngine &engine)
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(m_expected > 0);
+    --m_expected;
+    m_freeEngines << engine;
+    m_engineAdded.wakeAll();
+}
+
+QString XineEnginePool::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return QString::fromLatin1("%1 free engines (min %2, max %3), %4 hits, %5 misses, "
+            "%6 pre-warmed, %7 disposed")
+        .arg(m_freeEngines.size()).arg(m_minSize).arg(m_maxSize)
+        .arg(m_hits).arg(m_misses).arg(m_warmed).arg(m_disposed);
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
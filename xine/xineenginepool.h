@@ -0,0 +1,90 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_XINEENGINEPOOL_H
+#define PHONON_XINE_XINEENGINEPOOL_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QWaitCondition>
+
+#include "xineengine.h"
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief Free XineEngines, kept between \p minSize and \p maxSize engines.
+ *
+ * Creating an engine loads the config and scans the plugins, which takes long enough to be
+ * noticed. Whenever fewer than \p minSize engines are free a background thread creates new ones,
+ * so that acquire() only has to create an engine itself if more streams are created in a burst
+ * than there are pre-warmed engines. An engine that someone announced with expectEngine() and is
+ * still creating is waited for instead. The background thread runs at a low priority and is not
+ * waited for, a busy system could keep it from finishing for a long time. Engines that are
+ * returned while \p maxSize engines are free are disposed.
+ *
+ * All methods may be called from any thread.
+ */
+class XineEnginePool
+{
+    public:
+        XineEnginePool(int minSize, int maxSize);
+        ~XineEnginePool();
+
+        XineEngine acquire();
+        void release(const XineEngine &engine);
+
+        void expectEngine();
+        void addExpectedEngine(const XineEngine &engine);
+
+        QString statistics() const;
+
+    private:
+        class Warmer;
+        void warm();
+
+        mutable QMutex m_mutex;
+        QWaitCondition m_needEngines;
+        QWaitCondition m_engineAdded;
+        QList<XineEngine> m_freeEngines;
+        // engines that are being created and will be added to m_freeEngines: announced with
+        // expectEngine(), and by the Warmer
+        int m_expected;
+        int m_warming;
+        Warmer *m_warmer;
+        const int m_minSize;
+        const int m_maxSize;
+        bool m_quit;
+
+        // statistics
+        int m_hits;
+        int m_misses;
+        int m_warmed;
+        int m_disposed;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_XINEENGINEPOOL_H
+// vim: sw=4 ts=4 sts=4 et tw=100
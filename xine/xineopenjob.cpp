@@ -0,0 +1,123 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "xineopenjob.h"
+#include "backend.h"
+
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include <climits>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+class XineOpenJob::Thread : public QThread
+{
+    public:
+        Thread(XineOpenJob *job)
+            : m_job(job)
+        {
+            connect(this, SIGNAL(finished()), SLOT(deleteLater()));
+        }
+
+    protected:
+        void run() { m_job->run(); }
+
+    private:
+        QExplicitlySharedDataPointer<XineOpenJob> m_job;
+};
+
+XineOpenJob::XineOpenJob(const XineEngine &xine, xine_stream_t *stream, const QByteArray &mrl)
+    : m_xine(xine),
+    m_stream(stream),
+    m_mrl(mrl),
+    m_result(0),
+    m_done(false),
+    m_abandoned(false)
+{
+    // the Thread object is deleted from the event loop of the creating thread, so the reference it
+    // holds cannot go away before the creator has taken its own
+    (new Thread(this))->start();
+}
+
+// open thread
+void XineOpenJob::run()
+{
+    const int result = xine_open(m_stream, m_mrl.constData());
+    QMutexLocker locker(&m_mutex);
+    m_result = result;
+    m_done = true;
+    if (!m_abandoned) {
+        m_openDone.wakeAll();
+        return;
+    }
+    locker.unlock();
+    debug() << Q_FUNC_INFO << "disposing the abandoned stream for" << m_mrl.constData();
+    if (result) {
+        xine_close(m_stream);
+    }
+    xine_dispose(m_stream);
+    // nothing uses them anymore
+    if (m_resources.deinterlacer) {
+        xine_post_dispose(m_xine, m_resources.deinterlacer);
+    }
+    m_resources = XineOpenJobResources();
+}
+
+bool XineOpenJob::waitForOpen(int timeout)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_done) {
+        m_openDone.wait(&m_mutex, timeout < 0 ? ULONG_MAX : static_cast<unsigned long>(timeout));
+    }
+    return m_done;
+}
+
+bool XineOpenJob::isDone() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_done;
+}
+
+int XineOpenJob::result() const
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(m_done);
+    return m_result;
+}
+
+bool XineOpenJob::abandon(const XineOpenJobResources &resources)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_done) {
+        return false;
+    }
+    m_abandoned = true;
+    m_resources = resources;
+    return true;
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -0,0 +1,109 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_XINEOPENJOB_H
+#define PHONON_XINE_XINEOPENJOB_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedData>
+#include <QtCore/QWaitCondition>
+
+#include <xine.h>
+
+#include "shareddata.h"
+#include "xineengine.h"
+
+namespace Phonon
+{
+namespace Xine
+{
+
+/**
+ * \brief What a stream uses besides the xine_stream_t while it is in xine_open.
+ *
+ * An abandoned XineOpenJob releases it right after it disposed the stream.
+ */
+struct XineOpenJobResources
+{
+    XineOpenJobResources() : deinterlacer(0) {}
+
+    // the post plugin wired to the video source of the stream
+    xine_post_t *deinterlacer;
+    // the objects owning the ports the stream is wired to
+    QList<QExplicitlySharedDataPointer<SharedData> > portOwners;
+};
+
+/**
+ * \brief Calls xine_open for a stream in a thread of its own.
+ *
+ * The job starts when it is created. The thread running xine_open holds its own reference, so
+ * the owner can drop the job at any time. If the owner abandons the job while xine_open is still
+ * running, the stream is closed and disposed in that thread as soon as xine_open returns, and only
+ * then the resources handed to abandon() are released.
+ *
+ * All methods are called from the thread of the owning XineStream.
+ */
+class XineOpenJob : public QSharedData
+{
+    public:
+        XineOpenJob(const XineEngine &xine, xine_stream_t *stream, const QByteArray &mrl);
+
+        /**
+         * Waits at most \p timeout milliseconds, or forever if \p timeout is negative. Returns
+         * whether xine_open has returned.
+         */
+        bool waitForOpen(int timeout);
+        bool isDone() const;
+
+        /**
+         * The return value of xine_open. Only valid after waitForOpen or isDone returned true.
+         */
+        int result() const;
+
+        /**
+         * Gives up on the job. Returns true if the job took over the stream and \p resources.
+         * Returns false if xine_open has already returned, in which case the caller still owns
+         * both.
+         */
+        bool abandon(const XineOpenJobResources &resources);
+
+    private:
+        class Thread;
+        void run();
+
+        // keeps xine_t alive until the abandoned stream is disposed
+        const XineEngine m_xine;
+        xine_stream_t *const m_stream;
+        const QByteArray m_mrl;
+        XineOpenJobResources m_resources;
+        mutable QMutex m_mutex;
+        QWaitCondition m_openDone;
+        int m_result;
+        bool m_done;
+        bool m_abandoned;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_XINEOPENJOB_H
+// vim: sw=4 ts=4 sts=4 et tw=100
@@ -25,6 +25,8 @@
 #include <QtCore/QTextCodec>
 #include <QEvent>
 #include <QCoreApplication>
+#include <QThread>
+#include <QTime>
 #include <QTimer>
 #include <QVarLengthArray>
 #include <QUrl>
@@ -33,6 +35,7 @@
 #include "bytestream.h"
 #include "events.h"
 #include "mediaobject.h"
+#include "metadatacache.h"
 #include "videowidget.h"
 #include "xineengine.h"
 #include "xinethread.h"
@@ -53,6 +56,17 @@ namespace Phonon
 namespace Xine
 {
 
+/**
+ * Microseconds of CLOCK_MONOTONIC, which unlike gettimeofday does not jump when the wall clock is
+ * set.
+ */
+static qint64 monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<qint64>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
 void XineStream::xineEventListener(void *p, const xine_event_t *xineEvent)
 {
     if (!p || !xineEvent) {
@@ -60,11 +74,17 @@ void XineStream::xineEventListener(void *p, const xine_event_t *xineEvent)
     }
     //debug() << Q_FUNC_INFO << "Xine event: " << xineEvent->type << QByteArray((char *)xineEvent->data, xineEvent->data_length);
 
-    XineStream *xs = static_cast<XineStream *>(p);
+    PooledXineStream *pooled = static_cast<PooledXineStream *>(p);
+    // the owner cannot go away while its event is handled
+    QMutexLocker locker(&pooled->ownerMutex);
+    XineStream *xs = pooled->owner;
+    if (!xs) {
+        return;
+    }
 
     switch (xineEvent->type) {
     case XINE_EVENT_UI_SET_TITLE: /* request title display change in ui */
-        QCoreApplication::postEvent(xs, new QEVENT(NewMetaData));
+        xs->postNotifications(MetaDataNotification);
         break;
     case XINE_EVENT_UI_PLAYBACK_FINISHED: /* frontend can e.g. move on to next playlist entry */
         QCoreApplication::postEvent(xs, new QEVENT(MediaFinished));
@@ -72,7 +92,9 @@ void XineStream::xineEventListener(void *p, const xine_event_t *xineEvent)
     case XINE_EVENT_PROGRESS: /* index creation/network connections */
         {
             xine_progress_data_t *progress = static_cast<xine_progress_data_t *>(xineEvent->data);
-            QCoreApplication::postEvent(xs, new ProgressEvent(QString::fromUtf8(progress->description), progress->percent));
+            // only the latest value is of interest
+            xs->m_progress.fetchAndStoreOrdered(progress->percent);
+            xs->postNotifications(0);
         }
         break;
     case XINE_EVENT_SPU_BUTTON: // the mouse pointer enter/leave a button, used to change the cursor
@@ -87,9 +109,7 @@ void XineStream::xineEventListener(void *p, const xine_event_t *xineEvent)
         break;
     case XINE_EVENT_UI_CHANNELS_CHANGED:    /* inform ui that new channel info is available */
         debug() << Q_FUNC_INFO << "XINE_EVENT_UI_CHANNELS_CHANGED";
-        {
-            QCoreApplication::postEvent(xs, new QEVENT(UiChannelsChanged));
-        }
+        xs->postNotifications(ChannelsNotification);
         break;
     case XINE_EVENT_UI_MESSAGE:             /* message (dialog) for the ui to display */
         {
@@ -142,93 +162,196 @@ XineStream::XineStream()
     : QObject(0), // XineStream is ref-counted
     SourceNodeXT("MediaObject"),
     m_stream(0),
-    m_event_queue(0),
+    m_pooledStream(0),
     m_deinterlacer(0),
     m_xine(Backend::xineEngineForStream()),
-    m_nullAudioPort(0),
-    m_nullVideoPort(0),
     m_state(Phonon::LoadingState),
     m_prefinishMarkTimer(0),
+    m_lastTimeUpdate(0),
+    m_startVpts(0),
+    m_lastSeekRequest(0),
+    m_seekStarted(0),
+    m_seekTarget(0),
     m_errorType(Phonon::NoError),
     m_lastSeekCommand(0),
     m_volume(100),
 //    m_startTime(-1),
     m_totalTime(-1),
     m_currentTime(-1),
-    m_availableSubtitles(-1),
-    m_availableAudioChannels(-1),
-    m_availableTitles(-1),
-    m_availableChapters(-1),
-    m_availableAngles(-1),
     m_currentAngle(-1),
     m_currentTitle(-1),
     m_currentChapter(-1),
     m_transitionGap(0),
-    m_streamInfoReady(false),
-    m_hasVideo(false),
-    m_isSeekable(false),
+    m_handledSupersedingCommands(0),
+    m_notifications(0),
+    m_progress(-1),
+    m_streamInfoRequested(0),
+    m_nextStream(0),
+    m_nextPooledStream(0),
+    m_nextAudioPort(0),
+    m_nextVideoPort(0),
+    m_savedPrebuffer(-1),
     m_useGaplessPlayback(false),
     m_prefinishMarkReachedNotEmitted(true),
     m_ticking(false),
     m_closing(false),
-    m_tickTimer(this)
-{
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    m_nextMrlRequested(false),
+    m_nextMrlReceived(false),
+    m_seekInFlight(false),
+    m_seekPending(false),
+    m_scrubbing(false),
+    m_lastSeekWasFast(false),
+    m_tickTimer(this),
+    m_waitForPlayingTimer(this),
+    m_seekTimer(this),
+    m_nextOpenTimer(this),
+    m_prerollTimer(this),
+    m_poolExpiryTimer(this),
+    m_drainTimer(this)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
     connect(&m_tickTimer, SIGNAL(timeout()), SLOT(emitTick()), Qt::DirectConnection);
+    m_waitForPlayingTimer.setInterval(50);
+    connect(&m_waitForPlayingTimer, SIGNAL(timeout()), SLOT(checkPlaying()), Qt::DirectConnection);
+    m_seekTimer.setInterval(SeekPollInterval);
+    connect(&m_seekTimer, SIGNAL(timeout()), SLOT(checkSeek()), Qt::DirectConnection);
+    m_nextOpenTimer.setSingleShot(true);
+    m_nextOpenTimer.setInterval(50);
+    connect(&m_nextOpenTimer, SIGNAL(timeout()), SLOT(checkNextStreamOpened()), Qt::DirectConnection);
+    m_prerollTimer.setSingleShot(true);
+    connect(&m_prerollTimer, SIGNAL(timeout()), SLOT(requestNextMrl()), Qt::DirectConnection);
+    m_poolExpiryTimer.setSingleShot(true);
+    connect(&m_poolExpiryTimer, SIGNAL(timeout()), SLOT(expirePooledStreams()), Qt::DirectConnection);
+    m_drainTimer.setSingleShot(true);
+    connect(&m_drainTimer, SIGNAL(timeout()), SLOT(disposeDrainedStream()), Qt::DirectConnection);
 }
 
 XineStream::~XineStream()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
+    cancelPreroll();
+    XineStreamPool *pool = m_xine.streamPool();
+    while (!m_drainingStreams.isEmpty()) {
+        PooledXineStream *draining = m_drainingStreams.takeFirst();
+        xine_set_param(draining->stream, XINE_PARAM_GAPLESS_SWITCH, 1);
+        pool->dispose(draining);
+    }
     if (m_deinterlacer) {
         xine_post_dispose(m_xine, m_deinterlacer);
     }
-    if(m_event_queue) {
-        xine_event_dispose_queue(m_event_queue);
-        m_event_queue = 0;
-    }
-    if(m_stream) {
+    if (m_pooledStream) {
         // FIXME: when shutting down xine_dispose causes a crash 50% of the time. I failed to find
-        // the cause after many hours of searching
-        if (!Backend::inShutdown()) {
-            xine_dispose(m_stream);
-        }
+        // the cause after many hours of searching. XineStreamPool::dispose skips it then.
+        pool->dispose(m_pooledStream);
+        m_pooledStream = 0;
         m_stream = 0;
     }
+    // the pooled streams may use the null ports and keep the sinks alive
+    pool->clear();
     delete m_prefinishMarkTimer;
     m_prefinishMarkTimer = 0;
-    if (m_nullAudioPort) {
-        xine_close_audio_driver(m_xine, m_nullAudioPort);
-        m_nullAudioPort = 0;
+    closeNullPorts();
+    Backend::returnXineEngine(m_xine);
+}
+
+NullPorts::~NullPorts()
+{
+    if (audioPort) {
+        xine_close_audio_driver(m_xine, audioPort);
     }
-    if (m_nullVideoPort) {
-        xine_close_video_driver(m_xine, m_nullVideoPort);
-        m_nullVideoPort = 0;
+    if (videoPort) {
+        xine_close_video_driver(m_xine, videoPort);
+    }
+}
+
+// drops the reference to the null ports, they are closed when no pooled or abandoned stream uses
+// them anymore
+void XineStream::closeNullPorts()
+{
+    m_nullPorts.reset();
+}
+
+/**
+ * References to the objects owning the ports m_stream is wired to. m_portMutex must be locked.
+ */
+// xine thread
+QList<QExplicitlySharedDataPointer<SharedData> > XineStream::portOwners() const
+{
+    QList<QExplicitlySharedDataPointer<SharedData> > owners;
+    if (m_mediaObject) {
+        foreach (SinkNode *sink, m_mediaObject->sinks()) {
+            owners << QExplicitlySharedDataPointer<SharedData>(sink->threadSafeObject().data());
+        }
+    }
+    if (m_nullPorts) {
+        owners << QExplicitlySharedDataPointer<SharedData>(m_nullPorts.data());
+    }
+    return owners;
+}
+
+/**
+ * Closes \p s and puts it in the stream pool of the engine, keyed by the ports of the current
+ * sinks. The pool is emptied again if the XineStream does not need a stream for a while, so that
+ * the pooled streams do not keep audio devices open.
+ */
+// xine thread
+void XineStream::releaseStream(PooledXineStream *s)
+{
+    xine_audio_port_t *audioPort = 0;
+    xine_video_port_t *videoPort = 0;
+    QList<QExplicitlySharedDataPointer<SharedData> > sinks;
+    m_portMutex.lock();
+    if (m_mediaObject) {
+        sinkPorts(&audioPort, &videoPort);
+        sinks = portOwners();
+    } else {
+        s->reusable = false;
+    }
+    m_portMutex.unlock();
+    m_xine.streamPool()->release(s, audioPort, videoPort, sinks);
+    enum { PoolExpiryTime = 10000 };
+    m_poolExpiryTimer.start(PoolExpiryTime);
+}
+
+// xine thread
+void XineStream::expirePooledStreams()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    debug() << Q_FUNC_INFO << "disposing" << m_xine.streamPool()->size() << "pooled streams";
+    m_xine.streamPool()->clear();
+    if (!m_stream) {
+        // unloaded
+        closeNullPorts();
     }
-    Backend::returnXineEngine(m_xine);
 }
 
 xine_audio_port_t *XineStream::nullAudioPort() const
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
-    if (!m_nullAudioPort) {
-        m_nullAudioPort = xine_open_audio_driver(m_xine, "none", 0);
-        Q_ASSERT(m_nullAudioPort);
-        if (!m_nullAudioPort) {
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (!m_nullPorts) {
+        m_nullPorts = new NullPorts(m_xine);
+    }
+    if (!m_nullPorts->audioPort) {
+        m_nullPorts->audioPort = xine_open_audio_driver(m_xine, "none", 0);
+        Q_ASSERT(m_nullPorts->audioPort);
+        if (!m_nullPorts->audioPort) {
             //error(Phonon::FatalError, i18n("Your xine installation is incomplete. Please install the \"none\" output plugin for xine."));
         }
     }
-    return m_nullAudioPort;
+    return m_nullPorts->audioPort;
 }
 
 xine_video_port_t *XineStream::nullVideoPort() const
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
-    if (!m_nullVideoPort) {
-        m_nullVideoPort = xine_open_video_driver(m_xine, "auto", XINE_VISUAL_TYPE_NONE, 0);
-        Q_ASSERT(m_nullVideoPort);
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (!m_nullPorts) {
+        m_nullPorts = new NullPorts(m_xine);
+    }
+    if (!m_nullPorts->videoPort) {
+        m_nullPorts->videoPort = xine_open_video_driver(m_xine, "auto", XINE_VISUAL_TYPE_NONE, 0);
+        Q_ASSERT(m_nullPorts->videoPort);
     }
-    return m_nullVideoPort;
+    return m_nullPorts->videoPort;
 }
 
 // any thread
@@ -238,10 +361,91 @@ XineEngine XineStream::xine() const
     return m_xine;
 }
 
+static bool mrlNeedsDeinterlacer(const QByteArray &mrl)
+{
+    return (mrl.startsWith("dvd:/") && Backend::deinterlaceDVD()) ||
+        (mrl.startsWith("vcd:/") && Backend::deinterlaceVCD()) ||
+        (mrl.startsWith("file:/") && Backend::deinterlaceFile());
+}
+
+// xine thread
+bool XineStream::openSuperseded() const
+{
+    return m_closing || m_supersedingCommands != m_handledSupersedingCommands;
+}
+
+/**
+ * Runs xine_open and waits for it to return. In the meantime xine progress events are delivered,
+ * and the open is abandoned when it takes longer than Backend::openTimeout() or a stop(), setMrl()
+ * or closeBlocking() call is waiting.
+ *
+ * Returns the result of xine_open or -1 if the open was abandoned.
+ */
+// xine thread
+int XineStream::openStream()
+{
+    enum { PollInterval = 250 };
+    const int timeout = Backend::openTimeout();
+    QTime openTime;
+    openTime.start();
+
+    QExplicitlySharedDataPointer<XineOpenJob> job(new XineOpenJob(m_xine, m_stream, m_mrl));
+    while (!job->waitForOpen(PollInterval)) {
+        const bool timedOut = timeout > 0 && openTime.elapsed() >= timeout;
+        if (timedOut || openSuperseded()) {
+            debug() << Q_FUNC_INFO << "abandoning xine_open for m_mrl =" << m_mrl.constData()
+                << (timedOut ? "(timed out)" : "(cancelled)");
+            abandonStream(job.data());
+            if (timedOut) {
+                error(Phonon::NormalError, tr("Opening the media data at '<i>%1</i>' timed out").arg(m_mrl.constData()));
+            } else {
+                changeState(Phonon::StoppedState);
+            }
+            return -1;
+        }
+        // network connections and index creation report their progress while xine_open runs
+        deliverProgress();
+    }
+    return job->result();
+}
+
+/**
+ * Leaves m_stream to \p job, which may still be in xine_open. The job also takes the deinterlacer
+ * and references to the owners of the ports, the stream uses them until xine_open returns. The
+ * next MrlChanged event creates a new stream.
+ */
+// xine thread
+void XineStream::abandonStream(XineOpenJob *job)
+{
+    XineOpenJobResources resources;
+    m_portMutex.lock();
+    resources.portOwners = portOwners();
+    m_portMutex.unlock();
+
+    QMutexLocker locker(&m_mutex);
+    resources.deinterlacer = m_deinterlacer;
+    if (m_pooledStream) {
+        if (m_xine.streamPool()->abandon(m_pooledStream, job, resources)) {
+            // the job disposes it
+            m_deinterlacer = 0;
+        }
+        m_pooledStream = 0;
+    }
+    if (m_deinterlacer) {
+        // the stream it was wired to is disposed already
+        xine_post_dispose(m_xine, m_deinterlacer);
+        m_deinterlacer = 0;
+    }
+    m_stream = 0;
+    invalidateStreamInfo();
+    m_prefinishMarkReachedNotEmitted = true;
+    hackSetProperty("xine_stream_t", QVariant());
+}
+
 // xine thread
 bool XineStream::xineOpen(Phonon::State newstate)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     Q_ASSERT(m_stream);
     if (m_mrl.isEmpty() || m_closing) {
         return false;
@@ -259,7 +463,12 @@ bool XineStream::xineOpen(Phonon::State newstate)
 
     // xine_open can call functions from ByteStream which will block waiting for data.
     //debug() << Q_FUNC_INFO << "xine_open(" << m_mrl.constData() << ")";
-    if (xine_open(m_stream, m_mrl.constData()) == 0) {
+    const int opened = openStream();
+    if (opened < 0) {
+        // cancelled or timed out, m_stream is gone
+        return false;
+    }
+    if (opened == 0) {
         debug() << Q_FUNC_INFO << "xine_open failed for m_mrl =" << m_mrl.constData();
         switch (xine_get_error(m_stream)) {
         case XINE_ERROR_NONE:
@@ -288,10 +497,7 @@ bool XineStream::xineOpen(Phonon::State newstate)
         return false;
     }
     debug() << Q_FUNC_INFO << "xine_open succeeded for m_mrl =" << m_mrl.constData();
-    const bool needDeinterlacer =
-        (m_mrl.startsWith("dvd:/") && Backend::deinterlaceDVD()) ||
-        (m_mrl.startsWith("vcd:/") && Backend::deinterlaceVCD()) ||
-        (m_mrl.startsWith("file:/") && Backend::deinterlaceFile());
+    const bool needDeinterlacer = mrlNeedsDeinterlacer(m_mrl);
     if (m_deinterlacer) {
         if (!needDeinterlacer) {
             xine_post_dispose(m_xine, m_deinterlacer);
@@ -342,11 +548,14 @@ bool XineStream::xineOpen(Phonon::State newstate)
         }
     }
 
-    m_lastTimeUpdate.tv_sec = 0;
+    m_lastTimeUpdate = 0;
+    m_startVpts = 0;
     xine_get_pos_length(m_stream, 0, &m_currentTime, &m_totalTime);
+    publishTime();
     getStreamInfo();
     emit length(m_totalTime);
     updateMetaData();
+    storeCachedInfo();
     // if there's a PlayCommand in the event queue the state should not go to StoppedState
     changeState(newstate);
     return true;
@@ -355,10 +564,13 @@ bool XineStream::xineOpen(Phonon::State newstate)
 // called from main thread
 int XineStream::totalTime() const
 {
+    if (m_announced) {
+        return m_announcedInfo.read().totalTime;
+    }
     if (!m_stream || m_mrl.isEmpty()) {
         return -1;
     }
-    return m_totalTime;
+    return m_timeBase.read().totalTime;
 }
 
 // called from main thread
@@ -367,14 +579,8 @@ int XineStream::remainingTime() const
     if (!m_stream || m_mrl.isEmpty()) {
         return 0;
     }
-    QMutexLocker locker(&m_updateTimeMutex);
-    if (m_state == Phonon::PlayingState && m_lastTimeUpdate.tv_sec > 0) {
-        struct timeval now;
-        gettimeofday(&now, 0);
-        const int diff = (now.tv_sec - m_lastTimeUpdate.tv_sec) * 1000 + (now.tv_usec - m_lastTimeUpdate.tv_usec) / 1000;
-        return m_totalTime - (m_currentTime + diff);
-    }
-    return m_totalTime - m_currentTime;
+    const TimeBase timeBase = m_timeBase.read();
+    return timeBase.totalTime - extrapolatedTime(timeBase);
 }
 
 // called from main thread
@@ -383,55 +589,148 @@ int XineStream::currentTime() const
     if (!m_stream || m_mrl.isEmpty()) {
         return -1;
     }
-    QMutexLocker locker(&m_updateTimeMutex);
-    if (m_state == Phonon::PlayingState && m_lastTimeUpdate.tv_sec > 0) {
-        struct timeval now;
-        gettimeofday(&now, 0);
-        const int diff = (now.tv_sec - m_lastTimeUpdate.tv_sec) * 1000 + (now.tv_usec - m_lastTimeUpdate.tv_usec) / 1000;
-        return m_currentTime + diff;
+    return extrapolatedTime(m_timeBase.read());
+}
+
+/**
+ * Returns the position of the stream in microseconds, computed from the metronom clock of the
+ * engine. While playing, the returned values never decrease, unless the stream seeks.
+ *
+ * Until the position could be anchored to the clock after opening or seeking, this falls back to
+ * currentTime().
+ */
+// any thread
+qint64 XineStream::currentTimeUsecs() const
+{
+    if (!m_stream || m_mrl.isEmpty()) {
+        return -1;
+    }
+    const TimeBase timeBase = m_timeBase.read();
+    if (timeBase.startVpts == 0) {
+        return static_cast<qint64>(extrapolatedTime(timeBase)) * 1000;
     }
-    return m_currentTime;
+    // the clock belongs to the engine and lives as long as this object, unlike m_stream
+    xine_t *xine = m_xine;
+    const qint64 vpts = xine->clock->get_current_time(xine->clock);
+    // vpts run at 90 kHz
+    return qMax(Q_INT64_C(0), (vpts - timeBase.startVpts) * 100 / 9);
 }
 
+// any thread
+int XineStream::extrapolatedTime(const TimeBase &timeBase)
+{
+    if (timeBase.updated > 0) {
+        return timeBase.currentTime + static_cast<int>((monotonicTime() - timeBase.updated) / 1000);
+    }
+    return timeBase.currentTime;
+}
+
+/**
+ * Makes the current time base visible to the main thread. It has to be called whenever
+ * m_currentTime, m_totalTime, m_lastTimeUpdate or the state change.
+ */
+// xine thread
+void XineStream::publishTime()
+{
+    TimeBase timeBase;
+    timeBase.currentTime = m_currentTime;
+    timeBase.totalTime = m_totalTime;
+    // only extrapolate while playing
+    timeBase.updated = m_state == Phonon::PlayingState ? m_lastTimeUpdate : 0;
+    // the clock stands still while paused
+    timeBase.startVpts = m_state == Phonon::PlayingState || m_state == Phonon::PausedState ? m_startVpts : 0;
+    m_timeBase.write(timeBase);
+}
+
+/**
+ * Anchors the position to the metronom clock. Whenever xine presents a frame it updates the extra
+ * info of the stream, so the vpts and the input time found there belong together.
+ */
+// xine thread
+void XineStream::updateStartVpts()
+{
+    pthread_mutex_lock(&m_stream->current_extra_info_lock);
+    const qint64 frameVpts = m_stream->current_extra_info->vpts;
+    const int inputTime = m_stream->current_extra_info->input_time;
+    pthread_mutex_unlock(&m_stream->current_extra_info_lock);
+    if (frameVpts <= 0 || inputTime <= 0) {
+        return;
+    }
+    qint64 startVpts = frameVpts - static_cast<qint64>(inputTime) * 90;
+    if (m_streamInfo.current().hasVideo) {
+        // the extra info comes from the video frames, which are shown XINE_PARAM_AV_OFFSET later
+        // than the audio with the same pts. Users set the offset to make up for the latency of
+        // the audio output.
+        startVpts -= xine_get_param(m_stream, XINE_PARAM_AV_OFFSET);
+    } else {
+#ifdef AO_PROP_DRIVER_DELAY
+        // without video the audio output thread updates the extra info when it hands a buffer to
+        // the driver, which plays it only after the samples it still holds
+        xine_audio_port_t *port = m_stream->audio_out;
+        if (port) {
+            const int driverDelay = port->get_property(port, AO_PROP_DRIVER_DELAY);
+            if (driverDelay > 0) {
+                startVpts -= driverDelay;
+            }
+        }
+#endif // AO_PROP_DRIVER_DELAY
+    }
+    // input_time has millisecond resolution and lags behind by up to a frame. Moving the anchor
+    // forward would make the position go backwards, so that only happens for a real
+    // discontinuity.
+    enum { MaxJitter = 90 * 100 };
+    if (m_startVpts == 0 || startVpts < m_startVpts || startVpts - m_startVpts > MaxJitter) {
+        m_startVpts = startVpts;
+    }
+}
+
+/**
+ * Returns the last known value without waiting for the xine thread. If the stream info was not
+ * read yet it is requested, and hasVideoChanged is emitted when the value turns out to be
+ * different.
+ */
 // called from main thread
 bool XineStream::hasVideo() const
 {
-    if (!m_streamInfoReady) {
-        QMutexLocker locker(&m_streamInfoMutex);
-        QCoreApplication::postEvent(const_cast<XineStream *>(this), new QEVENT(GetStreamInfo));
-        // wait a few ms, perhaps the other thread finishes the event in time and this method
-        // can return a useful value
-        // FIXME: this is non-deterministic: a program might fail sometimes and sometimes work
-        // because of this
-        if (!m_waitingForStreamInfo.wait(&m_streamInfoMutex, 80)) {
-            debug() << Q_FUNC_INFO << "waitcondition timed out";
-        }
+    if (m_announced) {
+        return m_announcedInfo.read().hasVideo;
+    }
+    const StreamInfo info = m_streamInfo.read();
+    if (!info.ready) {
+        requestStreamInfo();
     }
-    return m_hasVideo;
+    return info.hasVideo;
 }
 
+/**
+ * \see hasVideo
+ */
 // called from main thread
 bool XineStream::isSeekable() const
 {
-    if (!m_streamInfoReady) {
-        //QMutexLocker locker(&m_streamInfoMutex);
+    if (m_announced) {
+        return m_announcedInfo.read().isSeekable;
+    }
+    const StreamInfo info = m_streamInfo.read();
+    if (!info.ready) {
+        requestStreamInfo();
+    }
+    return info.isSeekable;
+}
+
+// called from main thread
+void XineStream::requestStreamInfo() const
+{
+    // only one GetStreamInfo event at a time, no matter how often the UI asks
+    if (m_streamInfoRequested.testAndSetOrdered(0, 1)) {
         QCoreApplication::postEvent(const_cast<XineStream *>(this), new QEVENT(GetStreamInfo));
-        // wait a few ms, perhaps the other thread finishes the event in time and this method
-        // can return a useful value
-        // FIXME: this is non-deterministic: a program might fail sometimes and sometimes work
-        // because of this
-        /*if (!m_waitingForStreamInfo.wait(&m_streamInfoMutex, 80)) {
-            debug() << Q_FUNC_INFO << "waitcondition timed out";
-            return false;
-        } */
     }
-    return m_isSeekable;
 }
 
 // xine thread
 void XineStream::getStreamInfo()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
 
     if (m_stream && !m_mrl.isEmpty()) {
         if (xine_get_status(m_stream) == XINE_STATUS_IDLE) {
@@ -440,97 +739,225 @@ void XineStream::getStreamInfo()
                 return;
             }
         }
-        QMutexLocker locker(&m_streamInfoMutex);
-        bool hasVideo   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_HAS_VIDEO);
-        bool isSeekable = xine_get_stream_info(m_stream, XINE_STREAM_INFO_SEEKABLE);
-        int availableTitles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_TITLE_COUNT);
-        int availableChapters = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_CHAPTER_COUNT);
-        int availableAngles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_ANGLE_COUNT);
-        int availableSubtitles = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_SPU_CHANNEL);
-        int availableAudioChannels = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_AUDIO_CHANNEL);
-        m_streamInfoReady = true;
-        if (m_hasVideo != hasVideo) {
-            m_hasVideo = hasVideo;
-            emit hasVideoChanged(m_hasVideo);
-        }
-        if (m_isSeekable != isSeekable) {
-            m_isSeekable = isSeekable;
-            emit seekableChanged(m_isSeekable);
-        }
-        if (m_availableTitles != availableTitles) {
-            debug() << Q_FUNC_INFO << "available titles changed: " << availableTitles;
-            m_availableTitles = availableTitles;
-            emit availableTitlesChanged(m_availableTitles);
-        }
-        if (m_availableChapters != availableChapters) {
-            debug() << Q_FUNC_INFO << "available chapters changed: " << availableChapters;
-            m_availableChapters = availableChapters;
-            emit availableChaptersChanged(m_availableChapters);
-        }
-        if (m_availableAngles != availableAngles) {
-            debug() << Q_FUNC_INFO << "available angles changed: " << availableAngles;
-            m_availableAngles = availableAngles;
-            emit availableAnglesChanged(m_availableAngles);
-        }
-        if (m_availableSubtitles != availableSubtitles) {
-            debug() << Q_FUNC_INFO << "available angles changed: " << availableSubtitles;
-            m_availableSubtitles = availableSubtitles;
-            emit availableSubtitlesChanged();
-        }
-        if (m_availableAudioChannels != availableAudioChannels) {
-            debug() << Q_FUNC_INFO << "available angles changed: " << availableAudioChannels;
-            m_availableAudioChannels = availableAudioChannels;
-            emit availableAudioChannelsChanged();
-        }
-        if (m_hasVideo) {
-            uint32_t width = xine_get_stream_info(m_stream, XINE_STREAM_INFO_VIDEO_WIDTH);
-            uint32_t height = xine_get_stream_info(m_stream, XINE_STREAM_INFO_VIDEO_HEIGHT);
-            handleDownstreamEvent(new FrameFormatChangeEvent(width, height, 0, 0));
-        }
-    }
-    m_waitingForStreamInfo.wakeAll();
+        StreamInfo info;
+        info.ready = true;
+        info.hasVideo   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_HAS_VIDEO);
+        info.isSeekable = xine_get_stream_info(m_stream, XINE_STREAM_INFO_SEEKABLE);
+        info.availableTitles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_TITLE_COUNT);
+        info.availableChapters = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_CHAPTER_COUNT);
+        info.availableAngles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_ANGLE_COUNT);
+        info.availableSubtitles = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_SPU_CHANNEL);
+        info.availableAudioChannels = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_AUDIO_CHANNEL);
+        if (info.hasVideo) {
+            info.width = xine_get_stream_info(m_stream, XINE_STREAM_INFO_VIDEO_WIDTH);
+            info.height = xine_get_stream_info(m_stream, XINE_STREAM_INFO_VIDEO_HEIGHT);
+        }
+        publishStreamInfo(info);
+        if (info.hasVideo) {
+            handleDownstreamEvent(new FrameFormatChangeEvent(info.width, info.height, 0, 0));
+        }
+    }
 }
 
+/**
+ * Makes \p info visible to the main thread and emits the change signals for everything that
+ * differs from the previous stream info.
+ */
 // xine thread
-bool XineStream::createStream()
+void XineStream::publishStreamInfo(const StreamInfo &info)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    const StreamInfo old = m_streamInfo.current();
+    m_streamInfo.write(info);
+    if (old.hasVideo != info.hasVideo) {
+        emit hasVideoChanged(info.hasVideo);
+    }
+    if (old.isSeekable != info.isSeekable) {
+        emit seekableChanged(info.isSeekable);
+    }
+    if (old.availableTitles != info.availableTitles) {
+        debug() << Q_FUNC_INFO << "available titles changed: " << info.availableTitles;
+        emit availableTitlesChanged(info.availableTitles);
+    }
+    if (old.availableChapters != info.availableChapters) {
+        debug() << Q_FUNC_INFO << "available chapters changed: " << info.availableChapters;
+        emit availableChaptersChanged(info.availableChapters);
+    }
+    if (old.availableAngles != info.availableAngles) {
+        debug() << Q_FUNC_INFO << "available angles changed: " << info.availableAngles;
+        emit availableAnglesChanged(info.availableAngles);
+    }
+    if (old.availableSubtitles != info.availableSubtitles) {
+        debug() << Q_FUNC_INFO << "available subtitles changed: " << info.availableSubtitles;
+        emit availableSubtitlesChanged();
+    }
+    if (old.availableAudioChannels != info.availableAudioChannels) {
+        debug() << Q_FUNC_INFO << "available audio channels changed: " << info.availableAudioChannels;
+        emit availableAudioChannelsChanged();
+    }
+}
 
-    if (m_stream || m_state == Phonon::ErrorState) {
-        return false;
+/**
+ * The stream was closed. The old values stay visible until the next stream info is read, but
+ * the next query requests it.
+ */
+// xine thread
+void XineStream::invalidateStreamInfo()
+{
+    StreamInfo info = m_streamInfo.current();
+    if (info.ready) {
+        info.ready = false;
+        m_streamInfo.write(info);
     }
+}
 
-    m_portMutex.lock();
-    //debug() << Q_FUNC_INFO << "AudioPort.xinePort() = " << m_audioPort.xinePort();
-    xine_audio_port_t *audioPort = 0;
-    xine_video_port_t *videoPort = 0;
-    if (!m_mediaObject) {
-        qWarning("request to create a stream, but no valid audio/video outputs are given/available");
-        error(Phonon::FatalError, tr("Xine failed to create a stream."));
-        return false;
+/**
+ * Publishes what the meta data cache knows about m_mrl, so that the length, the meta data and
+ * the stream info are known before xine_open returns. The stream info stays marked as not ready,
+ * xineOpen replaces it with the real values.
+ */
+// xine thread
+void XineStream::useCachedInfo()
+{
+    MetaDataCache *cache = Backend::metaDataCache();
+    MetaDataCache::Entry entry;
+    if (!cache || !cache->find(m_mrl, &entry)) {
+        return;
+    }
+    debug() << Q_FUNC_INFO << "using the cached info for" << m_mrl.constData();
+    m_currentTime = 0;
+    m_totalTime = entry.totalTime;
+    publishTime();
+    emit length(m_totalTime);
+
+    StreamInfo info;
+    info.hasVideo = entry.hasVideo;
+    info.isSeekable = entry.isSeekable;
+    info.availableTitles = entry.availableTitles;
+    info.availableChapters = entry.availableChapters;
+    info.availableAngles = entry.availableAngles;
+    info.availableSubtitles = entry.availableSubtitles;
+    info.availableAudioChannels = entry.availableAudioChannels;
+    info.width = entry.width;
+    info.height = entry.height;
+    publishStreamInfo(info);
+
+    if (entry.metaData != m_metaDataMap) {
+        m_metaDataMap = entry.metaData;
+        emit metaDataChanged(m_metaDataMap);
+    }
+}
+
+/**
+ * Looks up \p mrl in the meta data cache when the MRL is set, so that the length, the meta data
+ * and whether the stream has video and is seekable are known right away instead of once the xine
+ * thread got to the MrlChanged event, which may be queued behind a xine_close of the previous
+ * stream.
+ */
+// called from main thread, after m_supersedingCommands was incremented for the MrlChanged event
+void XineStream::announceCachedInfo(const QByteArray &mrl)
+{
+    MetaDataCache *cache = Backend::metaDataCache();
+    MetaDataCache::Entry entry;
+    if (!cache || mrl.isEmpty() || !cache->find(mrl, &entry)) {
+        m_announced.fetchAndStoreOrdered(0);
+        return;
+    }
+    debug() << Q_FUNC_INFO << "announcing the cached info for" << mrl.constData();
+    AnnouncedInfo announced;
+    announced.totalTime = entry.totalTime;
+    announced.hasVideo = entry.hasVideo;
+    announced.isSeekable = entry.isSeekable;
+    m_announcedInfo.write(announced);
+    m_announced.fetchAndStoreOrdered(1);
+    emit length(entry.totalTime);
+    emit metaDataChanged(entry.metaData);
+}
+
+/**
+ * The xine thread published the info of m_mrl, the main thread stops using what setMrl announced.
+ * Unless another setMrl or stop is queued already: the announcement may be for its MRL.
+ */
+// xine thread
+void XineStream::retireAnnouncedInfo()
+{
+    if (m_supersedingCommands == m_handledSupersedingCommands) {
+        m_announced.fetchAndStoreOrdered(0);
     }
+}
+
+// xine thread
+void XineStream::storeCachedInfo()
+{
+    MetaDataCache *cache = Backend::metaDataCache();
+    const StreamInfo info = m_streamInfo.current();
+    if (!cache || !info.ready) {
+        return;
+    }
+    MetaDataCache::Entry entry;
+    entry.metaData = m_metaDataMap;
+    entry.totalTime = m_totalTime;
+    entry.hasVideo = info.hasVideo;
+    entry.isSeekable = info.isSeekable;
+    entry.availableTitles = info.availableTitles;
+    entry.availableChapters = info.availableChapters;
+    entry.availableAngles = info.availableAngles;
+    entry.availableSubtitles = info.availableSubtitles;
+    entry.availableAudioChannels = info.availableAudioChannels;
+    entry.width = info.width;
+    entry.height = info.height;
+    cache->insert(m_mrl, entry);
+}
+
+// xine thread, m_portMutex must be locked
+void XineStream::sinkPorts(xine_audio_port_t **audioPort, xine_video_port_t **videoPort) const
+{
+    Q_ASSERT(m_mediaObject);
+    *audioPort = 0;
+    *videoPort = 0;
     QSet<SinkNode *> sinks = m_mediaObject->sinks();
     debug() << Q_FUNC_INFO << "MediaObject is connected to " << sinks.size() << " nodes";
     foreach (SinkNode *sink, sinks) {
         Q_ASSERT(sink->threadSafeObject());
         if (sink->threadSafeObject()->audioPort()) {
-            Q_ASSERT(audioPort == 0);
-            audioPort = sink->threadSafeObject()->audioPort();
+            Q_ASSERT(*audioPort == 0);
+            *audioPort = sink->threadSafeObject()->audioPort();
         }
         if (sink->threadSafeObject()->videoPort()) {
-            Q_ASSERT(videoPort == 0);
-            videoPort = sink->threadSafeObject()->videoPort();
+            Q_ASSERT(*videoPort == 0);
+            *videoPort = sink->threadSafeObject()->videoPort();
         }
     }
-    if (!audioPort) {
+    if (!*audioPort) {
         debug() << Q_FUNC_INFO << "creating xine_stream with null audio port";
-        audioPort = nullAudioPort();
+        *audioPort = nullAudioPort();
     }
-    if (!videoPort) {
+    if (!*videoPort) {
         debug() << Q_FUNC_INFO << "creating xine_stream with null video port";
-        videoPort = nullVideoPort();
+        *videoPort = nullVideoPort();
+    }
+}
+
+// xine thread
+bool XineStream::createStream()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    if (m_stream || m_state == Phonon::ErrorState) {
+        return false;
+    }
+
+    m_portMutex.lock();
+    //debug() << Q_FUNC_INFO << "AudioPort.xinePort() = " << m_audioPort.xinePort();
+    xine_audio_port_t *audioPort = 0;
+    xine_video_port_t *videoPort = 0;
+    if (!m_mediaObject) {
+        qWarning("request to create a stream, but no valid audio/video outputs are given/available");
+        error(Phonon::FatalError, tr("Xine failed to create a stream."));
+        return false;
     }
-    m_stream = xine_stream_new(m_xine, audioPort, videoPort);
+    sinkPorts(&audioPort, &videoPort);
+    m_pooledStream = m_xine.streamPool()->acquire(audioPort, videoPort, this, &XineStream::xineEventListener);
+    m_stream = m_pooledStream ? m_pooledStream->stream : 0;
     hackSetProperty("xine_stream_t", QVariant::fromValue(static_cast<void *>(m_stream)));
 
     if (m_volume != 100) {
@@ -545,10 +972,6 @@ bool XineStream::createStream()
     m_portMutex.unlock();
     m_waitingForRewire.wakeAll();
 
-    Q_ASSERT(!m_event_queue);
-    m_event_queue = xine_event_new_queue(m_stream);
-    xine_event_create_listener_thread(m_event_queue, &XineStream::xineEventListener, (void *)this);
-
     if (m_useGaplessPlayback) {
         debug() << Q_FUNC_INFO << "XINE_PARAM_EARLY_FINISHED_EVENT: 1";
         xine_set_param(m_stream, XINE_PARAM_EARLY_FINISHED_EVENT, 1);
@@ -631,12 +1054,15 @@ void XineStream::gaplessSwitchTo(const QByteArray &mrl)
 // xine thread
 void XineStream::changeState(Phonon::State newstate)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (m_state == newstate) {
         return;
     }
     Phonon::State oldstate = m_state;
     m_state = newstate;
+    if (newstate == Phonon::PlayingState || oldstate == Phonon::PlayingState) {
+        publishTime();
+    }
     if (newstate == Phonon::PlayingState) {
         if (m_ticking) {
             m_tickTimer.start();
@@ -645,22 +1071,26 @@ void XineStream::changeState(Phonon::State newstate)
         if (m_prefinishMark > 0) {
             emitAboutToFinish();
         }
+        schedulePreroll();
     } else if (oldstate == Phonon::PlayingState) {
         m_tickTimer.stop();
+        m_prerollTimer.stop();
         //debug() << Q_FUNC_INFO << "tickTimer stopped.";
         m_prefinishMarkReachedNotEmitted = true;
         if (m_prefinishMarkTimer) {
             m_prefinishMarkTimer->stop();
         }
     }
+    if (newstate == Phonon::StoppedState || newstate == Phonon::LoadingState || newstate == Phonon::ErrorState) {
+        // the stream cannot seek anymore or is about to get a new source
+        cancelSeeks();
+    }
     if (newstate == Phonon::ErrorState) {
         debug() << Q_FUNC_INFO << "reached error state";// from: " << kBacktrace();
-        if (m_event_queue) {
-            xine_event_dispose_queue(m_event_queue);
-            m_event_queue = 0;
-        }
-        if (m_stream) {
-            xine_dispose(m_stream);
+        if (m_pooledStream) {
+            // don't reuse a stream that failed
+            m_xine.streamPool()->dispose(m_pooledStream);
+            m_pooledStream = 0;
             m_stream = 0;
             hackSetProperty("xine_stream_t", QVariant());
         }
@@ -732,19 +1162,21 @@ static bool checkIsUtf8(const char *buf)
     return isValidUtf8;
 }
 
-// xine thread
-void XineStream::updateMetaData()
+/**
+ * Reads the meta data of the opened \p stream, guessing the encoding of the strings.
+ */
+// any thread
+QMultiMap<QString, QString> XineStream::readMetaData(xine_stream_t *stream)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
     const char *meta[8] = {
-        xine_get_meta_info(m_stream, XINE_META_INFO_TITLE),
-        xine_get_meta_info(m_stream, XINE_META_INFO_ARTIST),
-        xine_get_meta_info(m_stream, XINE_META_INFO_GENRE),
-        xine_get_meta_info(m_stream, XINE_META_INFO_ALBUM),
-        xine_get_meta_info(m_stream, XINE_META_INFO_YEAR),
-        xine_get_meta_info(m_stream, XINE_META_INFO_TRACK_NUMBER),
-        xine_get_meta_info(m_stream, XINE_META_INFO_COMMENT),
-        xine_get_meta_info(m_stream, XINE_META_INFO_CDINDEX_DISCID)
+        xine_get_meta_info(stream, XINE_META_INFO_TITLE),
+        xine_get_meta_info(stream, XINE_META_INFO_ARTIST),
+        xine_get_meta_info(stream, XINE_META_INFO_GENRE),
+        xine_get_meta_info(stream, XINE_META_INFO_ALBUM),
+        xine_get_meta_info(stream, XINE_META_INFO_YEAR),
+        xine_get_meta_info(stream, XINE_META_INFO_TRACK_NUMBER),
+        xine_get_meta_info(stream, XINE_META_INFO_COMMENT),
+        xine_get_meta_info(stream, XINE_META_INFO_CDINDEX_DISCID)
     };
     bool isUtf8 = false;
     for (int i = 0; !isUtf8 && i < 8; ++i) {
@@ -770,6 +1202,14 @@ void XineStream::updateMetaData()
     metaDataMap.insert(QLatin1String("TRACKNUMBER"), codec->toUnicode(meta[5]));
     metaDataMap.insert(QLatin1String("DESCRIPTION"), codec->toUnicode(meta[6]));
     metaDataMap.insert(QLatin1String("MUSICBRAINZ_DISCID"), codec->toUnicode(meta[7]));
+    return metaDataMap;
+}
+
+// xine thread
+void XineStream::updateMetaData()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    const QMultiMap<QString, QString> metaDataMap = readMetaData(m_stream);
     if(metaDataMap == m_metaDataMap)
         return;
     m_metaDataMap = metaDataMap;
@@ -780,7 +1220,8 @@ void XineStream::updateMetaData()
 // xine thread
 void XineStream::playbackFinished()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
+    cancelPreroll();
     {
         QMutexLocker locker(&m_mutex);
         if (m_prefinishMarkReachedNotEmitted && m_prefinishMark > 0) {
@@ -793,7 +1234,7 @@ void XineStream::playbackFinished()
         if (m_stream) {
             xine_close(m_stream); // TODO: is it necessary? should xine_close be called as late as possible?
         }
-        m_streamInfoReady = false;
+        invalidateStreamInfo();
         m_prefinishMarkReachedNotEmitted = true;
         emit finished();
     }
@@ -803,7 +1244,7 @@ void XineStream::playbackFinished()
 // xine thread
 inline void XineStream::error(Phonon::ErrorType type, const QString &string)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     debug() << Q_FUNC_INFO << type << string;
     m_errorLock.lockForWrite();
     m_errorType = type;
@@ -812,23 +1253,89 @@ inline void XineStream::error(Phonon::ErrorType type, const QString &string)
     changeState(Phonon::ErrorState);
 }
 
+/**
+ * Called from the event listener with the notifications in \p bits. XINE_EVENT_PROGRESS, title and
+ * channel changes come in bursts while buffering or navigating DVD menus, so they are collected in
+ * m_notifications and m_progress and only one XineNotifications event is posted until the
+ * XineStream thread handled it.
+ */
+// event listener thread
+void XineStream::postNotifications(int bits)
+{
+    int pending;
+    do {
+        pending = m_notifications;
+    } while (!m_notifications.testAndSetOrdered(pending, pending | bits | NotificationsPosted));
+    if (!(pending & NotificationsPosted)) {
+        QCoreApplication::postEvent(this, new QEVENT(XineNotifications));
+    }
+}
+
+// xine thread
+void XineStream::deliverProgress()
+{
+    const int percent = m_progress.fetchAndStoreOrdered(-1);
+    if (percent < 0) {
+        return;
+    }
+    debug() << Q_FUNC_INFO << "progress:" << percent;
+    if (percent < 100) {
+        if (m_state == Phonon::PlayingState) {
+            changeState(Phonon::BufferingState);
+        }
+    } else {
+        if (m_state == Phonon::BufferingState) {
+            changeState(Phonon::PlayingState);
+        }
+        //QTimer::singleShot(20, this, SLOT(getStartTime()));
+    }
+    debug() << Q_FUNC_INFO << "emit bufferStatus(" << percent << ")";
+    emit bufferStatus(percent);
+}
+
+// xine thread
+void XineStream::handleChannelsChanged()
+{
+    if (!m_stream) {
+        return;
+    }
+    // check chapter, title, angle and substreams
+    int currentTitle   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_TITLE_NUMBER);
+    int currentChapter = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_CHAPTER_NUMBER);
+    int currentAngle   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_ANGLE_NUMBER);
+    if (currentAngle != m_currentAngle) {
+        debug() << Q_FUNC_INFO << "current angle changed: " << currentAngle;
+        m_currentAngle = currentAngle;
+        emit angleChanged(m_currentAngle);
+    }
+    if (currentChapter != m_currentChapter) {
+        debug() << Q_FUNC_INFO << "current chapter changed: " << currentChapter;
+        m_currentChapter = currentChapter;
+        emit chapterChanged(m_currentChapter);
+    }
+    if (currentTitle != m_currentTitle) {
+        debug() << Q_FUNC_INFO << "current title changed: " << currentTitle;
+        m_currentTitle = currentTitle;
+        emit titleChanged(m_currentTitle);
+    }
+    //Check if the MetaData needs to be updated, bug#199327.  -- klondike
+    getStreamInfo();
+    updateMetaData();
+}
+
 const char *nameForEvent(int e)
 {
     switch (e) {
     case Event::Reference:
         return "Reference";
-    case Event::UiChannelsChanged:
-        return "UiChannelsChanged";
     case Event::MediaFinished:
         return "MediaFinished";
     case Event::UpdateTime:
         return "UpdateTime";
     case Event::GaplessSwitch:
         return "GaplessSwitch";
-    case Event::NewMetaData:
-        return "NewMetaData";
-    case Event::Progress:
-        return "Progress";
+    case Event::XineNotifications:
+        return "XineNotifications";
     case Event::GetStreamInfo:
         return "GetStreamInfo";
     case Event::UpdateVolume:
@@ -866,11 +1373,282 @@ const char *nameForEvent(int e)
     }
 }
 
+/**
+ * With gapless playback the next source is asked for Backend::gaplessPrerollTime() milliseconds
+ * before the end of the current one, so that it can be opened on a second stream while the
+ * current one still plays.
+ */
+// xine thread
+void XineStream::schedulePreroll()
+{
+#ifdef XINE_PARAM_METRONOM_PREBUFFER
+    const int prerollTime = Backend::gaplessPrerollTime();
+    if (!m_useGaplessPlayback || prerollTime <= 0 || m_nextMrlRequested || m_state != Phonon::PlayingState) {
+        return;
+    }
+    updateTime();
+    if (m_totalTime <= 0) {
+        // the length is unknown, e.g. for a live stream
+        return;
+    }
+    m_prerollTimer.start(qMax(0, m_totalTime - m_currentTime - prerollTime));
+#endif // XINE_PARAM_METRONOM_PREBUFFER
+}
+
+// xine thread
+void XineStream::requestNextMrl()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (!m_useGaplessPlayback || m_nextMrlRequested || m_state != Phonon::PlayingState) {
+        return;
+    }
+    updateTime();
+    const int timeToRequest = m_totalTime - m_currentTime - Backend::gaplessPrerollTime();
+    if (timeToRequest > 150) {
+        // xine is not very accurate wrt time info
+        m_prerollTimer.start(timeToRequest);
+        return;
+    }
+    debug() << Q_FUNC_INFO << "asking for the next source" << m_totalTime - m_currentTime << "ms ahead";
+    m_nextMrlRequested = true;
+    emit needNextUrl();
+}
+
+// xine thread
+void XineStream::prerollNextStream()
+{
+    Q_ASSERT(!m_nextStream);
+    if (m_nextMrl.isEmpty() || m_closing || !m_stream || !m_mediaObject) {
+        return;
+    }
+    if (m_deinterlacer || mrlNeedsDeinterlacer(m_nextMrl)) {
+        // the deinterlacer is wired to m_stream, switch within m_stream instead
+        return;
+    }
+    if (m_nextMrl.startsWith("kbytestream:/")) {
+        // a ByteStream can be opened only once, there would be no way back if the preroll fails
+        return;
+    }
+    m_portMutex.lock();
+    sinkPorts(&m_nextAudioPort, &m_nextVideoPort);
+    m_portMutex.unlock();
+    // no owner yet, the events of the prerolled stream only matter once it replaced m_stream
+    m_nextPooledStream = m_xine.streamPool()->acquire(m_nextAudioPort, m_nextVideoPort, 0, &XineStream::xineEventListener);
+    if (!m_nextPooledStream) {
+        return;
+    }
+    m_nextStream = m_nextPooledStream->stream;
+    if (m_volume != 100) {
+        xine_set_param(m_nextStream, XINE_PARAM_AUDIO_AMP_LEVEL, m_volume);
+    }
+    xine_set_param(m_nextStream, XINE_PARAM_EARLY_FINISHED_EVENT, 1);
+    m_nextOpenJob = new XineOpenJob(m_xine, m_nextStream, m_nextMrl);
+}
+
+/**
+ * Called when m_stream finished and the next source was given ahead of time. The prerolled stream
+ * replaces m_stream and starts right where the frames the old stream left in the ports end. If
+ * there is no prerolled stream the switch happens within m_stream.
+ */
+// xine thread
+void XineStream::switchToNextStream()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    const QByteArray mrl = m_nextMrl;
+    m_nextMrl.clear();
+    m_nextMrlRequested = false;
+    m_nextMrlReceived = false;
+    if (!m_nextStream) {
+        gaplessSwitch(mrl);
+        return;
+    }
+    // the other streams of the thread must not wait for xine_open of the prerolled stream
+    m_switchMrl = mrl;
+    m_switchTime.start();
+    checkNextStreamOpened();
+}
+
+/**
+ * Completes switchToNextStream once xine_open of the prerolled stream returned. Until then it
+ * polls, and it gives the switch up when the open takes longer than Backend::openTimeout().
+ */
+// xine thread
+void XineStream::checkNextStreamOpened()
+{
+    if (!m_nextOpenJob || m_switchMrl.isEmpty()) {
+        // cancelPreroll was called meanwhile
+        return;
+    }
+    if (!m_nextOpenJob->isDone()) {
+        const int timeout = Backend::openTimeout();
+        if (timeout <= 0 || m_switchTime.elapsed() < timeout) {
+            m_nextOpenTimer.start();
+            return;
+        }
+        qWarning("xine_open for gapless playback timed out!");
+        m_switchMrl.clear();
+        discardNextStream();
+        gaplessSwitch(QByteArray());
+        return;
+    }
+    const QByteArray mrl = m_switchMrl;
+    m_switchMrl.clear();
+    xine_audio_port_t *audioPort;
+    xine_video_port_t *videoPort;
+    m_portMutex.lock();
+    sinkPorts(&audioPort, &videoPort);
+    m_portMutex.unlock();
+    if (!m_nextOpenJob->result() || audioPort != m_nextAudioPort || videoPort != m_nextVideoPort) {
+        debug() << Q_FUNC_INFO << "cannot use the prerolled stream for" << mrl.constData();
+        discardNextStream();
+        gaplessSwitch(mrl);
+        return;
+    }
+
+    updateTime();
+    const int remainingTime = qMax(0, m_totalTime - m_currentTime);
+    // checkSeek must not poll the prerolled stream for a seek on the old one
+    cancelSeeks();
+    m_mutex.lock();
+    // the old stream has to stay around until the frames it queued in the ports are played. They
+    // are played after those of the streams that are draining already, so the timer is moved
+    // to the deadline of this one.
+    m_pooledStream->setOwner(0);
+    m_drainingStreams << m_pooledStream;
+    m_drainTimer.start(remainingTime + 1000);
+    m_pooledStream = m_nextPooledStream;
+    m_pooledStream->setOwner(this);
+    m_stream = m_nextStream;
+    m_nextPooledStream = 0;
+    m_nextStream = 0;
+    m_nextOpenJob.reset();
+    setMrlInternal(mrl);
+    invalidateStreamInfo();
+    hackSetProperty("xine_stream_t", QVariant::fromValue(static_cast<void *>(m_stream)));
+    m_mutex.unlock();
+
+    debug() << Q_FUNC_INFO << "switched to the prerolled stream for" << m_mrl.constData()
+        << "," << remainingTime << "ms left on the previous stream";
+#ifdef XINE_PARAM_METRONOM_PREBUFFER
+    restoreMetronomPrebuffer();
+    m_savedPrebuffer = xine_get_param(m_stream, XINE_PARAM_METRONOM_PREBUFFER);
+    xine_set_param(m_stream, XINE_PARAM_METRONOM_PREBUFFER, remainingTime * 90);
+#endif // XINE_PARAM_METRONOM_PREBUFFER
+    xine_play(m_stream, 0, 0);
+    nextSourceStarted();
+}
+
+/**
+ * Sets the metronom prebuffer of m_stream back after it was used to line up a prerolled stream.
+ * Otherwise every later xine_play would wait as long.
+ */
+// xine thread
+void XineStream::restoreMetronomPrebuffer()
+{
+#ifdef XINE_PARAM_METRONOM_PREBUFFER
+    if (m_savedPrebuffer >= 0) {
+        if (m_stream) {
+            xine_set_param(m_stream, XINE_PARAM_METRONOM_PREBUFFER, m_savedPrebuffer);
+        }
+        m_savedPrebuffer = -1;
+    }
+#endif // XINE_PARAM_METRONOM_PREBUFFER
+}
+
+// xine thread
+void XineStream::disposeDrainedStream()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    restoreMetronomPrebuffer();
+    while (!m_drainingStreams.isEmpty()) {
+        PooledXineStream *drained = m_drainingStreams.takeFirst();
+        // m_stream shares the ports, xine_close must not discard the frames queued in them
+        xine_set_param(drained->stream, XINE_PARAM_GAPLESS_SWITCH, 1);
+        releaseStream(drained);
+    }
+}
+
+// xine thread
+void XineStream::discardNextStream()
+{
+    if (!m_nextPooledStream) {
+        return;
+    }
+    // the stream may still be in xine_open, make sure its xine_close leaves m_stream's frames alone
+    xine_set_param(m_nextStream, XINE_PARAM_GAPLESS_SWITCH, 1);
+    XineOpenJobResources resources;
+    m_portMutex.lock();
+    resources.portOwners = portOwners();
+    m_portMutex.unlock();
+    m_xine.streamPool()->abandon(m_nextPooledStream, m_nextOpenJob.data(), resources);
+    m_nextOpenJob.reset();
+    m_nextPooledStream = 0;
+    m_nextStream = 0;
+}
+
+// xine thread
+void XineStream::cancelPreroll()
+{
+    m_prerollTimer.stop();
+    m_nextOpenTimer.stop();
+    m_switchMrl.clear();
+    discardNextStream();
+    m_nextMrl.clear();
+    m_nextMrlRequested = false;
+    m_nextMrlReceived = false;
+}
+
+// xine thread
+void XineStream::gaplessSwitch(const QByteArray &mrl)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    m_mutex.lock();
+    if (mrl.isEmpty()) {
+        debug() << Q_FUNC_INFO << "no GaplessSwitch";
+    } else {
+        setMrlInternal(mrl);
+        debug() << Q_FUNC_INFO << "GaplessSwitch new m_mrl =" << m_mrl.constData();
+    }
+    if (mrl.isEmpty() || m_closing) {
+        xine_set_param(m_stream, XINE_PARAM_GAPLESS_SWITCH, 0);
+        m_mutex.unlock();
+        playbackFinished();
+        return;
+    }
+    if (!xine_open(m_stream, m_mrl.constData())) {
+        qWarning("xine_open for gapless playback failed!");
+        xine_set_param(m_stream, XINE_PARAM_GAPLESS_SWITCH, 0);
+        m_mutex.unlock();
+        playbackFinished();
+        return; // FIXME: correct?
+    }
+    m_mutex.unlock();
+    xine_play(m_stream, 0, 0);
+    nextSourceStarted();
+}
+
+// xine thread
+void XineStream::nextSourceStarted()
+{
+    if (m_prefinishMarkReachedNotEmitted && m_prefinishMark > 0) {
+        emit prefinishMarkReached(0);
+    }
+    m_prefinishMarkReachedNotEmitted = true;
+    // seeks that were scheduled for the previous source don't apply to this one
+    cancelSeeks();
+    // updateTime anchors the position to the new stream once its first frame is presented
+    m_startVpts = 0;
+    getStreamInfo();
+    updateTime();
+    updateMetaData();
+    schedulePreroll();
+}
+
 // xine thread
 bool XineStream::event(QEvent *ev)
 {
     if (ev->type() != QEvent::ThreadChange) {
-        Q_ASSERT(QThread::currentThread() == XineThread::instance());
+        Q_ASSERT(QThread::currentThread() == thread());
     }
     const char *eventName = nameForEvent(ev->type());
     if (m_closing) {
@@ -880,6 +1658,11 @@ bool XineStream::event(QEvent *ev)
         case Event::MrlChanged:
         //case Event::ChangeAudioPostList:
             break;
+        case Event::XineNotifications:
+            // drop them, but let the event listener post again
+            m_notifications = 0;
+            m_progress = -1;
+            return QObject::event(ev);
         default:
             if (eventName) {
                 debug() << Q_FUNC_INFO << "####################### ignoring Event: " << eventName;
@@ -888,12 +1671,7 @@ bool XineStream::event(QEvent *ev)
         }
     }
     if (eventName) {
-        if (static_cast<int>(ev->type()) == Event::Progress) {
-            ProgressEvent *e = static_cast<ProgressEvent *>(ev);
-            debug() << Q_FUNC_INFO << "################################ Event: " << eventName << ": " << e->percent;
-        } else {
-            debug() << Q_FUNC_INFO << "################################ Event: " << eventName;
-        }
+        debug() << Q_FUNC_INFO << "################################ Event: " << eventName;
     }
     switch (ev->type()) {
     case Event::Reference:
@@ -904,7 +1682,7 @@ bool XineStream::event(QEvent *ev)
             if (xine_get_status(m_stream) != XINE_STATUS_IDLE) {
                 m_mutex.lock();
                 xine_close(m_stream);
-                m_streamInfoReady = false;
+                invalidateStreamInfo();
                 m_prefinishMarkReachedNotEmitted = true;
                 m_mutex.unlock();
             }
@@ -913,69 +1691,18 @@ bool XineStream::event(QEvent *ev)
             }
         }
         return true;
-    case Event::UiChannelsChanged:
+    case Event::XineNotifications:
         ev->accept();
-        // check chapter, title, angle and substreams
-        if (m_stream) {
-            int availableTitles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_TITLE_COUNT);
-            int availableChapters = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_CHAPTER_COUNT);
-            int availableAngles   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_ANGLE_COUNT);
-            if (m_availableTitles != availableTitles) {
-                debug() << Q_FUNC_INFO << "available titles changed: " << availableTitles;
-                m_availableTitles = availableTitles;
-                emit availableTitlesChanged(m_availableTitles);
-            }
-            if (m_availableChapters != availableChapters) {
-                debug() << Q_FUNC_INFO << "available chapters changed: " << availableChapters;
-                m_availableChapters = availableChapters;
-                emit availableChaptersChanged(m_availableChapters);
-            }
-            if (m_availableAngles != availableAngles) {
-                debug() << Q_FUNC_INFO << "available angles changed: " << availableAngles;
-                m_availableAngles = availableAngles;
-                emit availableAnglesChanged(m_availableAngles);
-            }
-
-            {
-                const int availableSubtitles = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_SPU_CHANNEL);
-                if(availableSubtitles != m_availableSubtitles)
-                {
-                    debug() << Q_FUNC_INFO << "available subtitles changed: " << availableSubtitles;
-                    m_availableSubtitles = availableSubtitles;
-                    emit availableSubtitlesChanged();
-                }
-            }
-            {
-                const int availableAudioChannels = xine_get_stream_info(m_stream, XINE_STREAM_INFO_MAX_AUDIO_CHANNEL);
-                if(availableAudioChannels != m_availableAudioChannels)
-                {
-                    debug() << Q_FUNC_INFO << "available audio channels changed: " << availableAudioChannels;
-                    m_availableAudioChannels = availableAudioChannels;
-                    emit availableAudioChannelsChanged();
-                }
-            }
-
-            int currentTitle   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_TITLE_NUMBER);
-            int currentChapter = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_CHAPTER_NUMBER);
-            int currentAngle   = xine_get_stream_info(m_stream, XINE_STREAM_INFO_DVD_ANGLE_NUMBER);
-            if (currentAngle != m_currentAngle) {
-                debug() << Q_FUNC_INFO << "current angle changed: " << currentAngle;
-                m_currentAngle = currentAngle;
-                emit angleChanged(m_currentAngle);
-            }
-            if (currentChapter != m_currentChapter) {
-                debug() << Q_FUNC_INFO << "current chapter changed: " << currentChapter;
-                m_currentChapter = currentChapter;
-                emit chapterChanged(m_currentChapter);
-            }
-            if (currentTitle != m_currentTitle) {
-                debug() << Q_FUNC_INFO << "current title changed: " << currentTitle;
-                m_currentTitle = currentTitle;
-                emit titleChanged(m_currentTitle);
+        {
+            // from now on the event listener posts a new event for new notifications
+            const int pending = m_notifications.fetchAndStoreOrdered(0);
+            deliverProgress();
+            if (pending & ChannelsNotification) {
+                handleChannelsChanged();
+            } else if ((pending & MetaDataNotification) && m_stream) {
+                getStreamInfo();
+                updateMetaData();
             }
-            //Check if the MetaData needs to be updated, bug#199327.  -- klondike
-            getStreamInfo();
-            updateMetaData();
         }
         return true;
     case Event::Error:
@@ -1031,7 +1758,14 @@ bool XineStream::event(QEvent *ev)
             if (m_useGaplessPlayback) {
                 xine_set_param(m_stream, XINE_PARAM_GAPLESS_SWITCH, 1);
             }
-            emit needNextUrl();
+            if (!m_nextMrlRequested) {
+                emit needNextUrl();
+            } else if (m_nextMrlReceived) {
+                switchToNextStream();
+            } else {
+                // the answer is still outstanding, it is handled like a normal GaplessSwitch
+                m_nextMrlRequested = false;
+            }
         }
         return true;
     case Event::UpdateTime:
@@ -1042,65 +1776,22 @@ bool XineStream::event(QEvent *ev)
         ev->accept();
         {
             GaplessSwitchEvent *e = static_cast<GaplessSwitchEvent *>(ev);
-            m_mutex.lock();
-            if (e->mrl.isEmpty()) {
-                debug() << Q_FUNC_INFO << "no GaplessSwitch";
-            } else {
-                setMrlInternal(e->mrl);
-                debug() << Q_FUNC_INFO << "GaplessSwitch new m_mrl =" << m_mrl.constData();
-            }
-            if (e->mrl.isEmpty() || m_closing) {
-                xine_set_param(m_stream, XINE_PARAM_GAPLESS_SWITCH, 0);
-                m_mutex.unlock();
-                playbackFinished();
+            if (m_nextMrlRequested) {
+                // the current source is still playing, open the next one next to it
+                debug() << Q_FUNC_INFO << "prerolling" << e->mrl.constData();
+                discardNextStream();
+                m_nextMrlReceived = true;
+                m_nextMrl = e->mrl;
+                prerollNextStream();
                 return true;
             }
-            if (!xine_open(m_stream, m_mrl.constData())) {
-                qWarning("xine_open for gapless playback failed!");
-                xine_set_param(m_stream, XINE_PARAM_GAPLESS_SWITCH, 0);
-                m_mutex.unlock();
-                playbackFinished();
-                return true; // FIXME: correct?
-            }
-            m_mutex.unlock();
-            xine_play(m_stream, 0, 0);
-
-            if (m_prefinishMarkReachedNotEmitted && m_prefinishMark > 0) {
-                emit prefinishMarkReached(0);
-            }
-            m_prefinishMarkReachedNotEmitted = true;
-            getStreamInfo();
-            updateTime();
-            updateMetaData();
-        }
-        return true;
-    case Event::NewMetaData:
-        ev->accept();
-        if (m_stream) {
-            getStreamInfo();
-            updateMetaData();
+            gaplessSwitch(e->mrl);
         }
         return true;
-    case Event::Progress:
-        {
-            ProgressEvent *e = static_cast<ProgressEvent *>(ev);
-            if (e->percent < 100) {
-                if (m_state == Phonon::PlayingState) {
-                    changeState(Phonon::BufferingState);
-                }
-            } else {
-                if (m_state == Phonon::BufferingState) {
-                    changeState(Phonon::PlayingState);
-                }
-                //QTimer::singleShot(20, this, SLOT(getStartTime()));
-            }
-            debug() << Q_FUNC_INFO << "emit bufferStatus(" << e->percent << ")";
-            emit bufferStatus(e->percent);
-        }
-        ev->accept();
-        return true;
     case Event::GetStreamInfo:
         ev->accept();
+        // from now on a query has to post a new event
+        m_streamInfoRequested = 0;
         if (m_stream) {
             getStreamInfo();
         }
@@ -1113,6 +1804,9 @@ bool XineStream::event(QEvent *ev)
             if (m_stream) {
                 xine_set_param(m_stream, XINE_PARAM_AUDIO_AMP_LEVEL, m_volume);
             }
+            if (m_nextStream) {
+                xine_set_param(m_nextStream, XINE_PARAM_AUDIO_AMP_LEVEL, m_volume);
+            }
         }
         return true;
     case Event::RequestSnapshot:
@@ -1226,6 +1920,8 @@ bool XineStream::event(QEvent *ev)
         return true;
     case Event::MrlChanged:
         ev->accept();
+        ++m_handledSupersedingCommands;
+        cancelPreroll();
         {
             MrlChangedEvent *e = static_cast<MrlChangedEvent *>(ev);
             /* Always handle a MRL change request. We assume the application knows what it's
@@ -1251,15 +1947,18 @@ bool XineStream::event(QEvent *ev)
             } else if (xine_get_status(m_stream) != XINE_STATUS_IDLE) {
                 m_mutex.lock();
                 xine_close(m_stream);
-                m_streamInfoReady = false;
+                invalidateStreamInfo();
                 m_prefinishMarkReachedNotEmitted = true;
                 changeState(Phonon::LoadingState);
                 m_mutex.unlock();
             }
             if (m_closing || m_mrl.isEmpty()) {
                 debug() << Q_FUNC_INFO << "MrlChanged: don't call xineOpen. m_closing =" << m_closing << ", m_mrl =" << m_mrl.constData();
+                retireAnnouncedInfo();
                 m_waitingForClose.wakeAll();
             } else {
+                useCachedInfo();
+                retireAnnouncedInfo();
                 debug() << Q_FUNC_INFO << "calling xineOpen from MrlChanged";
                 if (!xineOpen(Phonon::StoppedState)) {
                     return true;
@@ -1314,6 +2013,11 @@ bool XineStream::event(QEvent *ev)
                 xine_set_param(m_stream, XINE_PARAM_EARLY_FINISHED_EVENT, 0);
             }
         }
+        if (m_useGaplessPlayback) {
+            schedulePreroll();
+        } else {
+            cancelPreroll();
+        }
         ev->accept();
         return true;
     case Event::RewireVideoToNull:
@@ -1323,11 +2027,19 @@ bool XineStream::event(QEvent *ev)
             if (!m_stream) {
                 return true;
             }
+            {
+                QMutexLocker portLocker(&m_portMutex);
+                debug() << Q_FUNC_INFO << "rewiring ports";
+                xine_post_out_t *videoSource = xine_get_video_source(m_stream);
+                xine_video_port_t *videoPort = nullVideoPort();
+                xine_post_wire_video_port(videoSource, videoPort);
+                // the pool does not know about the new wiring
+                m_pooledStream->reusable = false;
+            }
+            // the prerolled stream uses the video port that is about to go away, it needs
+            // m_portMutex to collect the owners of the ports
+            discardNextStream();
             QMutexLocker portLocker(&m_portMutex);
-            debug() << Q_FUNC_INFO << "rewiring ports";
-            xine_post_out_t *videoSource = xine_get_video_source(m_stream);
-            xine_video_port_t *videoPort = nullVideoPort();
-            xine_post_wire_video_port(videoSource, videoPort);
             m_waitingForRewire.wakeAll();
         }
         return true;
@@ -1406,6 +2118,9 @@ bool XineStream::event(QEvent *ev)
         return true;
     case Event::StopCommand:
         ev->accept();
+        ++m_handledSupersedingCommands;
+        retireAnnouncedInfo();
+        cancelPreroll();
         if (m_state == Phonon::ErrorState || m_state == Phonon::LoadingState || m_state == Phonon::StoppedState) {
             return true;
         }
@@ -1429,27 +2144,26 @@ bool XineStream::event(QEvent *ev)
         return true;
     case Event::UnloadCommand:
         ev->accept();
+        cancelPreroll();
         if (m_deinterlacer) {
             xine_post_dispose(m_xine, m_deinterlacer);
             m_deinterlacer = 0;
+            if (m_pooledStream) {
+                // the video source of the stream was wired to the deinterlacer
+                m_pooledStream->reusable = false;
+            }
         }
-        if(m_event_queue) {
-            xine_event_dispose_queue(m_event_queue);
-            m_event_queue = 0;
-        }
-        if(m_stream) {
-            xine_dispose(m_stream);
+        if (m_pooledStream) {
+            restoreMetronomPrebuffer();
+            releaseStream(m_pooledStream);
+            m_pooledStream = 0;
             m_stream = 0;
         }
         delete m_prefinishMarkTimer;
         m_prefinishMarkTimer = 0;
-        if (m_nullAudioPort) {
-            xine_close_audio_driver(m_xine, m_nullAudioPort);
-            m_nullAudioPort = 0;
-        }
-        if (m_nullVideoPort) {
-            xine_close_video_driver(m_xine, m_nullVideoPort);
-            m_nullVideoPort = 0;
+        if (m_xine.streamPool()->size() == 0) {
+            // else expirePooledStreams closes them
+            closeNullPorts();
         }
         return true;
     case Event::SetTickInterval:
@@ -1489,60 +2203,14 @@ bool XineStream::event(QEvent *ev)
         return true;
     case Event::SeekCommand:
         ev->accept();
-        if (m_state == Phonon::ErrorState || !m_isSeekable) {
+        if (m_state == Phonon::ErrorState || !m_streamInfo.current().isSeekable) {
             return true;
         } else {
             SeekCommandEvent *e = static_cast<SeekCommandEvent *>(ev);
             if (m_lastSeekCommand != e) { // a newer SeekCommand is in the pipe, ignore this one
                 return true;
             }
-            switch(m_state) {
-            case Phonon::PausedState:
-            case Phonon::BufferingState:
-            case Phonon::PlayingState:
-                debug() << Q_FUNC_INFO << "seeking xine stream to " << e->time << "ms";
-                // xine_trick_mode aborts :(
-                //if (0 == xine_trick_mode(m_stream, XINE_TRICK_MODE_SEEK_TO_TIME, e->time)) {
-                xine_play(m_stream, 0, e->time);
-
-#ifdef XINE_PARAM_DELAY_FINISHED_EVENT
-                if (!m_useGaplessPlayback && m_transitionGap > 0) {
-                    debug() << Q_FUNC_INFO << "XINE_PARAM_DELAY_FINISHED_EVENT:" << m_transitionGap;
-                    xine_set_param(m_stream, XINE_PARAM_DELAY_FINISHED_EVENT, m_transitionGap);
-                }
-#endif // XINE_PARAM_DELAY_FINISHED_EVENT
-
-                if (Phonon::PausedState == m_state) {
-                    // go back to paused speed after seek
-                    xine_set_param(m_stream, XINE_PARAM_SPEED, XINE_SPEED_PAUSE);
-                } else if (Phonon::PlayingState == m_state) {
-                    gettimeofday(&m_lastTimeUpdate, 0);
-                }
-                //}
-                break;
-            case Phonon::StoppedState:
-            case Phonon::ErrorState:
-            case Phonon::LoadingState:
-                return true; // cannot seek
-            }
-
-            // The stream demuxer will (hopefully) give us a better idea of
-            // where we are in the stream (maybe it will round the time to the
-            // nearest frame rather than the exact time desired).
-            if (!xine_get_pos_length(m_stream, 0, &m_currentTime, 0) || !m_currentTime)
-                m_currentTime = e->time;
-
-            const int timeToSignal = m_totalTime - m_prefinishMark - e->time;
-            if (m_prefinishMark > 0) {
-                if (timeToSignal > 0) { // not about to finish
-                    m_prefinishMarkReachedNotEmitted = true;
-                    emitAboutToFinishIn(timeToSignal);
-                } else if (m_prefinishMarkReachedNotEmitted) {
-                    m_prefinishMarkReachedNotEmitted = false;
-                    debug() << Q_FUNC_INFO << "emitting prefinishMarkReached(" << timeToSignal + m_prefinishMark << ")";
-                    emit prefinishMarkReached(timeToSignal + m_prefinishMark);
-                }
-            }
+            scheduleSeek(e->time);
         }
         return true;
     default:
@@ -1557,6 +2225,7 @@ void XineStream::closeBlocking()
     m_closing = true;
     if (m_stream && xine_get_status(m_stream) != XINE_STATUS_IDLE) {
         // this event will call xine_close
+        m_supersedingCommands.ref();
         QCoreApplication::postEvent(this, new MrlChangedEvent(QByteArray(), StoppedState));
 
         // wait until the xine_close is done
@@ -1703,7 +2372,7 @@ SubtitleDescription XineStream::currentSubtitle() const
 
 xine_post_out_t *XineStream::audioOutputPort() const
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (!m_stream) {
         return 0;
     }
@@ -1712,7 +2381,7 @@ xine_post_out_t *XineStream::audioOutputPort() const
 
 xine_post_out_t *XineStream::videoOutputPort() const
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (!m_stream) {
         return 0;
     }
@@ -1726,6 +2395,9 @@ xine_post_out_t *XineStream::videoOutputPort() const
 void XineStream::setMrl(const QByteArray &mrl, StateForNewMrl sfnm)
 {
     debug() << Q_FUNC_INFO << mrl << ", " << sfnm;
+    // a xine_open still running for the previous MRL is abandoned
+    m_supersedingCommands.ref();
+    announceCachedInfo(mrl);
     QCoreApplication::postEvent(this, new MrlChangedEvent(mrl, sfnm));
 }
 
@@ -1744,6 +2416,7 @@ void XineStream::pause()
 // called from main thread
 void XineStream::stop()
 {
+    m_supersedingCommands.ref();
     QCoreApplication::postEvent(this, new QEVENT(StopCommand));
 }
 
@@ -1759,10 +2432,158 @@ void XineStream::seek(qint64 time)
     QCoreApplication::postEvent(this, m_lastSeekCommand);
 }
 
+/**
+ * Seeks are issued at the rate the decoders can complete them: while a seek is still running only
+ * the latest target is remembered and sought to once the running seek has presented its first
+ * frame.
+ *
+ * Seeks that come in faster than ScrubInterval are taken as timeline scrubbing and use the fast
+ * mode of performSeek. When scrubbing ends one accurate seek to the final target follows.
+ */
+// xine thread
+void XineStream::scheduleSeek(int time)
+{
+    const qint64 now = monotonicTime() / 1000;
+    if (m_lastSeekRequest > 0 && now - m_lastSeekRequest < ScrubInterval) {
+        m_scrubbing = true;
+    }
+    m_lastSeekRequest = now;
+    m_seekTarget = time;
+    if (m_seekInFlight && !seekCompleted(now)) {
+        m_seekPending = true;
+    } else {
+        performSeek(time, m_scrubbing);
+    }
+    if (m_seekInFlight || m_seekPending || m_scrubbing) {
+        m_seekTimer.start();
+    }
+}
+
+// xine thread
+void XineStream::checkSeek()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    const qint64 now = monotonicTime() / 1000;
+    if (m_seekInFlight && !seekCompleted(now)) {
+        return;
+    }
+    m_seekInFlight = false;
+    if (m_scrubbing && now - m_lastSeekRequest >= ScrubInterval) {
+        // scrubbing ended, replace the approximate position by the exact one
+        m_scrubbing = false;
+        if (m_lastSeekWasFast || m_seekPending) {
+            m_seekPending = false;
+            performSeek(m_seekTarget, false);
+        }
+    } else if (m_seekPending) {
+        m_seekPending = false;
+        performSeek(m_seekTarget, m_scrubbing);
+    }
+    if (!m_seekInFlight && !m_scrubbing) {
+        m_seekTimer.stop();
+    }
+}
+
+// xine thread
+void XineStream::cancelSeeks()
+{
+    m_seekTimer.stop();
+    m_seekInFlight = false;
+    m_seekPending = false;
+    m_scrubbing = false;
+    m_lastSeekWasFast = false;
+    m_lastSeekRequest = 0;
+}
+
+/**
+ * Whether the last seek presented its first frame. xine counts the seeks of a stream and tags the
+ * frames with that count, the extra info of the stream is that of the last presented frame.
+ */
+// xine thread
+bool XineStream::seekCompleted(qint64 now) const
+{
+    if (!m_stream || now - m_seekStarted >= MaxSeekTime) {
+        // e.g. no frame is presented after seeking a paused audio stream
+        return true;
+    }
+    pthread_mutex_lock(&m_stream->current_extra_info_lock);
+    const bool completed = m_stream->current_extra_info->seek_count == m_stream->video_seek_count;
+    pthread_mutex_unlock(&m_stream->current_extra_info_lock);
+    return completed;
+}
+
+/**
+ * Seeks m_stream to \p time. The accurate seek asks the demuxer for the time. The fast seek asks
+ * it for the corresponding byte position, which demuxers find without searching their index or
+ * bisecting the file, and decoding starts at the next keyframe after it.
+ */
+// xine thread
+void XineStream::performSeek(int time, bool fast)
+{
+    switch(m_state) {
+    case Phonon::PausedState:
+    case Phonon::BufferingState:
+    case Phonon::PlayingState:
+        debug() << Q_FUNC_INFO << "seeking xine stream to " << time << "ms" << (fast ? "(fast)" : "");
+        // xine_trick_mode aborts :(
+        //if (0 == xine_trick_mode(m_stream, XINE_TRICK_MODE_SEEK_TO_TIME, time)) {
+        restoreMetronomPrebuffer();
+        if (fast && m_totalTime > 0) {
+            xine_play(m_stream, static_cast<int>(qBound(Q_INT64_C(0), static_cast<qint64>(time) * 65535 / m_totalTime, Q_INT64_C(65535))), 0);
+        } else {
+            xine_play(m_stream, 0, time);
+        }
+        m_seekInFlight = true;
+        m_seekStarted = monotonicTime() / 1000;
+        m_lastSeekWasFast = fast;
+
+#ifdef XINE_PARAM_DELAY_FINISHED_EVENT
+        if (!m_useGaplessPlayback && m_transitionGap > 0) {
+            debug() << Q_FUNC_INFO << "XINE_PARAM_DELAY_FINISHED_EVENT:" << m_transitionGap;
+            xine_set_param(m_stream, XINE_PARAM_DELAY_FINISHED_EVENT, m_transitionGap);
+        }
+#endif // XINE_PARAM_DELAY_FINISHED_EVENT
+
+        if (Phonon::PausedState == m_state) {
+            // go back to paused speed after seek
+            xine_set_param(m_stream, XINE_PARAM_SPEED, XINE_SPEED_PAUSE);
+        } else if (Phonon::PlayingState == m_state) {
+            m_lastTimeUpdate = monotonicTime();
+        }
+        m_startVpts = 0;
+        //}
+        break;
+    case Phonon::StoppedState:
+    case Phonon::ErrorState:
+    case Phonon::LoadingState:
+        return; // cannot seek
+    }
+
+    // The stream demuxer will (hopefully) give us a better idea of
+    // where we are in the stream (maybe it will round the time to the
+    // nearest frame rather than the exact time desired).
+    if (!xine_get_pos_length(m_stream, 0, &m_currentTime, 0) || !m_currentTime)
+        m_currentTime = time;
+    publishTime();
+
+    const int timeToSignal = m_totalTime - m_prefinishMark - time;
+    if (m_prefinishMark > 0) {
+        if (timeToSignal > 0) { // not about to finish
+            m_prefinishMarkReachedNotEmitted = true;
+            emitAboutToFinishIn(timeToSignal);
+        } else if (m_prefinishMarkReachedNotEmitted) {
+            m_prefinishMarkReachedNotEmitted = false;
+            debug() << Q_FUNC_INFO << "emitting prefinishMarkReached(" << timeToSignal + m_prefinishMark << ")";
+            emit prefinishMarkReached(timeToSignal + m_prefinishMark);
+        }
+    }
+    schedulePreroll();
+}
+
 // xine thread
 bool XineStream::updateTime()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (!m_stream) {
         return false;
     }
@@ -1774,44 +2595,49 @@ bool XineStream::updateTime()
         }
     }
 
-    QMutexLocker locker(&m_updateTimeMutex);
     int newTotalTime;
     int newCurrentTime;
     if (xine_get_pos_length(m_stream, 0, &newCurrentTime, &newTotalTime) != 1) {
         //m_currentTime = -1;
         //m_totalTime = -1;
-        //m_lastTimeUpdate.tv_sec = 0;
+        //m_lastTimeUpdate = 0;
         return false;
     }
     if (newTotalTime != m_totalTime) {
         m_totalTime = newTotalTime;
+        publishTime();
         emit length(m_totalTime);
     }
     if (newCurrentTime <= 0) {
         // are we seeking? when xine seeks xine_get_pos_length returns 0 for m_currentTime
-        //m_lastTimeUpdate.tv_sec = 0;
-        // XineStream::currentTime will still return the old value counting with gettimeofday
+        //m_lastTimeUpdate = 0;
+        // XineStream::currentTime will still return the old value counting with the monotonic
+        // clock
         return false;
     }
     if (m_state == Phonon::PlayingState && m_currentTime != newCurrentTime) {
-        gettimeofday(&m_lastTimeUpdate, 0);
+        m_lastTimeUpdate = monotonicTime();
     } else {
-        m_lastTimeUpdate.tv_sec = 0;
+        m_lastTimeUpdate = 0;
     }
     m_currentTime = newCurrentTime;
+    if (m_state == Phonon::PlayingState) {
+        updateStartVpts();
+    }
+    publishTime();
     return true;
 }
 
 // xine thread
 void XineStream::emitAboutToFinishIn(int timeToAboutToFinishSignal)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     //debug() << Q_FUNC_INFO << timeToAboutToFinishSignal;
     Q_ASSERT(m_prefinishMark > 0);
     if (!m_prefinishMarkTimer) {
-        m_prefinishMarkTimer = new QTimer(this);
+        m_prefinishMarkTimer = new WheelTimer(this);
         //m_prefinishMarkTimer->setObjectName("prefinishMarkReached timer");
-        Q_ASSERT(m_prefinishMarkTimer->thread() == XineThread::instance());
+        Q_ASSERT(m_prefinishMarkTimer->thread() == thread());
         m_prefinishMarkTimer->setSingleShot(true);
         connect(m_prefinishMarkTimer, SIGNAL(timeout()), SLOT(emitAboutToFinish()), Qt::DirectConnection);
     }
@@ -1827,7 +2653,7 @@ void XineStream::emitAboutToFinishIn(int timeToAboutToFinishSignal)
 // xine thread
 void XineStream::emitAboutToFinish()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     //debug() << Q_FUNC_INFO << m_prefinishMarkReachedNotEmitted << ", " << m_prefinishMark;
     if (m_prefinishMarkReachedNotEmitted && m_prefinishMark > 0) {
         updateTime();
@@ -1845,38 +2671,31 @@ void XineStream::emitAboutToFinish()
 }
 
 // xine thread
-void XineStream::timerEvent(QTimerEvent *event)
-{
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
-    if (m_waitForPlayingTimerId == event->timerId()) {
-        if (m_state != Phonon::BufferingState) {
-            // the state has already changed somewhere else (probably from XineProgressEvents)
-            killTimer(m_waitForPlayingTimerId);
-            m_waitForPlayingTimerId = -1;
-            return;
-        }
-        if (updateTime()) {
-            changeState(Phonon::PlayingState);
-            killTimer(m_waitForPlayingTimerId);
-            m_waitForPlayingTimerId = -1;
-        } else {
-            if (xine_get_status(m_stream) == XINE_STATUS_IDLE) {
-                changeState(Phonon::StoppedState);
-                killTimer(m_waitForPlayingTimerId);
-                m_waitForPlayingTimerId = -1;
-            //} else {
-                //debug() << Q_FUNC_INFO << "waiting";
-            }
-        }
+void XineStream::checkPlaying()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (m_state != Phonon::BufferingState) {
+        // the state has already changed somewhere else (probably from XineProgressEvents)
+        m_waitForPlayingTimer.stop();
+        return;
+    }
+    if (updateTime()) {
+        changeState(Phonon::PlayingState);
+        m_waitForPlayingTimer.stop();
     } else {
-        QObject::timerEvent(event);
+        if (xine_get_status(m_stream) == XINE_STATUS_IDLE) {
+            changeState(Phonon::StoppedState);
+            m_waitForPlayingTimer.stop();
+        //} else {
+            //debug() << Q_FUNC_INFO << "waiting";
+        }
     }
 }
 
 // xine thread
 void XineStream::emitTick()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (!updateTime()) {
         debug() << Q_FUNC_INFO << "no useful time information available. skipped.";
         return;
@@ -1903,7 +2722,7 @@ void XineStream::emitTick()
 // xine thread
 void XineStream::getStartTime()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
 //X     if (m_startTime == -1 || m_startTime == 0) {
 //X         int total;
 //X         if (xine_get_pos_length(m_stream, 0, &m_startTime, &total) == 1) {
@@ -1920,7 +2739,7 @@ void XineStream::getStartTime()
 
 void XineStream::internalPause()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (m_state == Phonon::PlayingState || m_state == Phonon::BufferingState) {
         xine_set_param(m_stream, XINE_PARAM_SPEED, XINE_SPEED_PAUSE);
         changeState(Phonon::PausedState);
@@ -1933,7 +2752,7 @@ void XineStream::internalPause()
 
 void XineStream::internalPlay()
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     xine_play(m_stream, 0, 0);
 
 #ifdef XINE_PARAM_DELAY_FINISHED_EVENT
@@ -1947,13 +2766,13 @@ void XineStream::internalPlay()
         changeState(Phonon::PlayingState);
     } else {
         changeState(Phonon::BufferingState);
-        m_waitForPlayingTimerId = startTimer(50);
+        m_waitForPlayingTimer.start();
     }
 }
 
 void XineStream::setMrlInternal(const QByteArray &newMrl)
 {
-    Q_ASSERT(QThread::currentThread() == XineThread::instance());
+    Q_ASSERT(QThread::currentThread() == thread());
     if (newMrl != m_mrl) {
         if (m_mrl.startsWith("kbytestream:/")) {
             Q_ASSERT(m_byteStream);
@@ -23,10 +23,14 @@
 
 #include "sourcenode.h"
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QList>
 #include <QtCore/QObject>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QMutex>
 #include <QtCore/QMultiMap>
+#include <QtCore/QTime>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QTimer>
 
@@ -36,10 +40,12 @@
 
 #include <xine.h>
 
-#include <sys/time.h>
 #include <time.h>
 #include "xineengine.h"
 #include "myshareddatapointer.h"
+#include "seqlock.h"
+#include "timerwheel.h"
+#include "xineopenjob.h"
 
 namespace Phonon
 {
@@ -50,6 +56,23 @@ class SeekCommandEvent;
 class MediaObject;
 class ByteStream;
 
+/**
+ * \brief The ports a XineStream wires its streams to when no sink provides one.
+ *
+ * The ports are closed with the last reference, so pooled streams and streams abandoned in
+ * xine_open keep them open after the XineStream let go of them.
+ */
+class NullPorts : public SharedData
+{
+    public:
+        NullPorts(const XineEngine &xine) : m_xine(xine), audioPort(0), videoPort(0) {}
+        ~NullPorts();
+
+        const XineEngine m_xine;
+        xine_audio_port_t *audioPort;
+        xine_video_port_t *videoPort;
+};
+
 /**
  * \brief xine_stream_t wrapper that runs in its own thread.
  *
@@ -73,6 +96,7 @@ class XineStream : public QObject, public SourceNodeXT
         int totalTime() const;
         int remainingTime() const;
         int currentTime() const;
+        qint64 currentTimeUsecs() const;
         bool hasVideo() const;
         bool isSeekable() const;
 
@@ -102,9 +126,9 @@ class XineStream : public QObject, public SourceNodeXT
         QString errorString() const;
         Phonon::ErrorType errorType() const;
 
-        int availableChapters() const { return m_availableChapters; }
-        int availableAngles()   const { return m_availableAngles;   }
-        int availableTitles()   const { return m_availableTitles;   }
+        int availableChapters() const { return m_streamInfo.read().availableChapters; }
+        int availableAngles()   const { return m_streamInfo.read().availableAngles;   }
+        int availableTitles()   const { return m_streamInfo.read().availableTitles;   }
         int currentChapter()    const { return m_currentChapter;    }
         int currentAngle()      const { return m_currentAngle;      }
         int currentTitle()      const { return m_currentTitle;      }
@@ -138,6 +162,8 @@ class XineStream : public QObject, public SourceNodeXT
         xine_video_port_t *nullVideoPort() const;
         XineEngine xine() const;
 
+        static QMultiMap<QString, QString> readMetaData(xine_stream_t *stream);
+
         void setMediaObject(MediaObject *m) { m_mediaObject = m; }
         void handleDownstreamEvent(Event *e);
 
@@ -179,24 +205,133 @@ class XineStream : public QObject, public SourceNodeXT
 
     protected:
         bool event(QEvent *ev);
-        void timerEvent(QTimerEvent *event);
 
     private slots:
         void getStartTime();
         void emitAboutToFinish();
         void emitTick();
+        void checkPlaying();
+        void checkSeek();
 
     private slots:
         void playbackFinished();
+        void requestNextMrl();
+        void checkNextStreamOpened();
+        void disposeDrainedStream();
+        void expirePooledStreams();
 
     private:
+        /**
+         * What xine knows about the open stream. It is written by the xine thread and read by the
+         * main thread without waiting for the xine thread.
+         */
+        struct StreamInfo
+        {
+            StreamInfo()
+                : ready(false), hasVideo(false), isSeekable(false), availableTitles(-1),
+                availableChapters(-1), availableAngles(-1), availableSubtitles(-1),
+                availableAudioChannels(-1), width(0), height(0)
+            {}
+
+            // false until the stream was opened and the values were read
+            bool ready;
+            bool hasVideo;
+            bool isSeekable;
+            int availableTitles;
+            int availableChapters;
+            int availableAngles;
+            int availableSubtitles;
+            int availableAudioChannels;
+            int width;
+            int height;
+        };
+
+        enum Notification {
+            MetaDataNotification = 1,
+            ChannelsNotification = 2,
+            // a XineNotifications event is on its way
+            NotificationsPosted = 4
+        };
+        void postNotifications(int bits);
+        void deliverProgress();
+        void handleChannelsChanged();
+
+        enum SeekTiming {
+            // seeks coming in faster than this are taken as scrubbing
+            ScrubInterval = 250,
+            SeekPollInterval = 20,
+            // give up waiting for the first frame after a seek
+            MaxSeekTime = 1000
+        };
+        void scheduleSeek(int time);
+        void performSeek(int time, bool fast);
+        bool seekCompleted(qint64 now) const;
+        void cancelSeeks();
+
         void getStreamInfo();
+        void publishStreamInfo(const StreamInfo &info);
+        void requestStreamInfo() const;
+        void invalidateStreamInfo();
+        void useCachedInfo();
+        void storeCachedInfo();
+        void announceCachedInfo(const QByteArray &mrl);
+        void retireAnnouncedInfo();
+
+        /**
+         * The playback position as last read from xine. The main thread extrapolates from it
+         * while playing.
+         */
+        struct TimeBase
+        {
+            TimeBase() : currentTime(-1), totalTime(-1), updated(0), startVpts(0) {}
+
+            int currentTime;
+            int totalTime;
+            // CLOCK_MONOTONIC in microseconds when currentTime was read, 0 if the position is not
+            // advancing
+            qint64 updated;
+            // the vpts at which the beginning of the stream is audible, 0 if unknown
+            qint64 startVpts;
+        };
+
+        /**
+         * What setMrl found in the meta data cache for the new MRL. Only what depends on the file
+         * alone, the main thread answers with it until the xine thread got to the MrlChanged
+         * event and published the values itself.
+         */
+        struct AnnouncedInfo
+        {
+            AnnouncedInfo() : totalTime(-1), hasVideo(false), isSeekable(false) {}
+
+            int totalTime;
+            bool hasVideo;
+            bool isSeekable;
+        };
+
+        void publishTime();
+        static int extrapolatedTime(const TimeBase &timeBase);
         bool xineOpen(Phonon::State);
+        int openStream();
+        bool openSuperseded() const;
+        void abandonStream(XineOpenJob *job);
         void updateMetaData();
         bool createStream();
+        void releaseStream(PooledXineStream *s);
+        void closeNullPorts();
+        QList<QExplicitlySharedDataPointer<SharedData> > portOwners() const;
+        void sinkPorts(xine_audio_port_t **audioPort, xine_video_port_t **videoPort) const;
+        void gaplessSwitch(const QByteArray &mrl);
+        void nextSourceStarted();
+        void schedulePreroll();
+        void prerollNextStream();
+        void switchToNextStream();
+        void restoreMetronomPrebuffer();
+        void discardNextStream();
+        void cancelPreroll();
         void changeState(Phonon::State newstate);
         void emitAboutToFinishIn(int timeToAboutToFinishSignal);
         bool updateTime();
+        void updateStartVpts();
         void error(Phonon::ErrorType, const QString &);
         void internalPause();
         void internalPlay();
@@ -206,27 +341,31 @@ class XineStream : public QObject, public SourceNodeXT
         uint streamHash() const;
 
         xine_stream_t *m_stream;
-        xine_event_queue_t *m_event_queue;
+        // the pool entry of m_stream, it owns the event queue
+        PooledXineStream *m_pooledStream;
         xine_post_t *m_deinterlacer;
         mutable XineEngine m_xine;
-        mutable xine_audio_port_t *m_nullAudioPort;
-        mutable xine_video_port_t *m_nullVideoPort;
+        mutable QExplicitlySharedDataPointer<NullPorts> m_nullPorts;
 
         Phonon::State m_state;
 
         QMutex m_portMutex;
         mutable QReadWriteLock m_errorLock;
         mutable QMutex m_mutex;
-        mutable QMutex m_streamInfoMutex;
-        mutable QMutex m_updateTimeMutex;
-        mutable QWaitCondition m_waitingForStreamInfo;
         QWaitCondition m_waitingForClose;
         QWaitCondition m_waitingForRewire;
         QMultiMap<QString, QString> m_metaDataMap;
         QByteArray m_mrl;
         MySharedDataPointer<ByteStream> m_byteStream;
-        QTimer *m_prefinishMarkTimer;
-        struct timeval m_lastTimeUpdate;
+        WheelTimer *m_prefinishMarkTimer;
+        // CLOCK_MONOTONIC in microseconds when m_currentTime last changed while playing, or 0
+        qint64 m_lastTimeUpdate;
+        // xine thread: see TimeBase::startVpts
+        qint64 m_startVpts;
+        // seek scheduling, times in milliseconds of the monotonic clock
+        qint64 m_lastSeekRequest;
+        qint64 m_seekStarted;
+        int m_seekTarget;
 
         QString m_errorString;
         Phonon::ErrorType m_errorType;
@@ -238,25 +377,64 @@ class XineStream : public QObject, public SourceNodeXT
         int m_startTime;
         int m_totalTime;
         int m_currentTime;
-        int m_waitForPlayingTimerId;
-        int m_availableSubtitles;
-        int m_availableAudioChannels;
-        int m_availableTitles;
-        int m_availableChapters;
-        int m_availableAngles;
         int m_currentAngle;
         int m_currentTitle;
         int m_currentChapter;
         int m_transitionGap;
-        bool m_streamInfoReady : 1;
-        bool m_hasVideo : 1;
-        bool m_isSeekable : 1;
+        // incremented in the main thread for every command that makes a running xine_open obsolete
+        QAtomicInt m_supersedingCommands;
+        // xine thread: how many of those commands were handled already
+        int m_handledSupersedingCommands;
+        // coalesced notifications of the event listener, see postNotifications
+        QAtomicInt m_notifications;
+        // the latest XINE_EVENT_PROGRESS percentage that was not delivered yet, or -1
+        QAtomicInt m_progress;
+        SeqLock<StreamInfo> m_streamInfo;
+        // m_currentTime, m_totalTime and m_lastTimeUpdate for the main thread
+        SeqLock<TimeBase> m_timeBase;
+        // written by the main thread, used while m_announced is set
+        SeqLock<AnnouncedInfo> m_announcedInfo;
+        QAtomicInt m_announced;
+        // set by the main thread while a GetStreamInfo event is pending
+        mutable QAtomicInt m_streamInfoRequested;
+        // the next source for gapless playback, opened while m_stream still plays
+        xine_stream_t *m_nextStream;
+        PooledXineStream *m_nextPooledStream;
+        xine_audio_port_t *m_nextAudioPort;
+        xine_video_port_t *m_nextVideoPort;
+        QExplicitlySharedDataPointer<XineOpenJob> m_nextOpenJob;
+        QByteArray m_nextMrl;
+        // m_stream finished before m_nextOpenJob was done: the MRL to switch to once it is, and
+        // since when the switch waits
+        QByteArray m_switchMrl;
+        QTime m_switchTime;
+        // previous streams whose frames are still queued in the ports
+        QList<PooledXineStream *> m_drainingStreams;
+        int m_savedPrebuffer;
         bool m_useGaplessPlayback : 1;
         bool m_prefinishMarkReachedNotEmitted : 1;
         bool m_ticking : 1;
         bool m_closing : 1;
         bool m_eventLoopReady : 1;
-        QTimer m_tickTimer;
+        // needNextUrl was emitted before m_stream finished
+        bool m_nextMrlRequested : 1;
+        // and the GaplessSwitch answering it arrived
+        bool m_nextMrlReceived : 1;
+        // a seek was issued and has not presented a frame yet
+        bool m_seekInFlight : 1;
+        // and m_seekTarget has to be sought to after it
+        bool m_seekPending : 1;
+        bool m_scrubbing : 1;
+        bool m_lastSeekWasFast : 1;
+        // the timers are scheduled on the TimerWheel of the thread
+        WheelTimer m_tickTimer;
+        WheelTimer m_waitForPlayingTimer;
+        WheelTimer m_seekTimer;
+        WheelTimer m_nextOpenTimer;
+        WheelTimer m_prerollTimer;
+        WheelTimer m_poolExpiryTimer;
+        // disposes of m_drainingStreams once the frames of the last one were played
+        WheelTimer m_drainTimer;
 };
 
 } // namespace Xine
@@ -0,0 +1,181 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#include "xinestreampool.h"
+#include "backend.h"
+#include "xineopenjob.h"
+
+#include <QtCore/QMutexLocker>
+
+namespace Phonon
+{
+namespace Xine
+{
+
+PooledXineStream::PooledXineStream(xine_stream_t *s, xine_audio_port_t *ap, xine_video_port_t *vp)
+    : stream(s),
+    eventQueue(0),
+    audioPort(ap),
+    videoPort(vp),
+    reusable(true),
+    prebuffer(-1),
+    owner(0)
+{
+#ifdef XINE_PARAM_METRONOM_PREBUFFER
+    prebuffer = xine_get_param(stream, XINE_PARAM_METRONOM_PREBUFFER);
+#endif // XINE_PARAM_METRONOM_PREBUFFER
+}
+
+void PooledXineStream::setOwner(XineStream *newOwner)
+{
+    QMutexLocker locker(&ownerMutex);
+    owner = newOwner;
+}
+
+XineStreamPool::XineStreamPool(xine_t *xine)
+    : m_xine(xine)
+{
+}
+
+XineStreamPool::~XineStreamPool()
+{
+    foreach (PooledXineStream *s, m_streams) {
+        xine_event_dispose_queue(s->eventQueue);
+        xine_dispose(s->stream);
+        delete s;
+    }
+}
+
+PooledXineStream *XineStreamPool::acquire(xine_audio_port_t *audioPort, xine_video_port_t *videoPort,
+        XineStream *owner, xine_event_listener_cb_t listener)
+{
+    PooledXineStream *s = 0;
+    m_mutex.lock();
+    // prefer the most recently released stream
+    for (int i = m_streams.size() - 1; i >= 0; --i) {
+        if (m_streams.at(i)->audioPort == audioPort && m_streams.at(i)->videoPort == videoPort) {
+            s = m_streams.takeAt(i);
+            break;
+        }
+    }
+    m_mutex.unlock();
+    if (s) {
+        debug() << Q_FUNC_INFO << "reusing xine_stream" << static_cast<void *>(s->stream);
+        // the stream holds on to the ports itself now
+        s->sinks.clear();
+        s->setOwner(owner);
+        return s;
+    }
+
+    xine_stream_t *stream = xine_stream_new(m_xine, audioPort, videoPort);
+    if (!stream) {
+        return 0;
+    }
+    s = new PooledXineStream(stream, audioPort, videoPort);
+    s->owner = owner;
+    s->eventQueue = xine_event_new_queue(stream);
+    xine_event_create_listener_thread(s->eventQueue, listener, static_cast<void *>(s));
+    return s;
+}
+
+void XineStreamPool::release(PooledXineStream *s, xine_audio_port_t *audioPort, xine_video_port_t *videoPort,
+        const QList<QExplicitlySharedDataPointer<SharedData> > &sinks)
+{
+    s->setOwner(0);
+    const int poolSize = Backend::streamPoolSize();
+    if (!s->reusable || poolSize <= 0) {
+        dispose(s);
+        return;
+    }
+    xine_close(s->stream);
+    // reset everything XineStream changes to what a new stream starts with
+    xine_set_param(s->stream, XINE_PARAM_GAPLESS_SWITCH, 0);
+    xine_set_param(s->stream, XINE_PARAM_EARLY_FINISHED_EVENT, 0);
+#ifdef XINE_PARAM_DELAY_FINISHED_EVENT
+    xine_set_param(s->stream, XINE_PARAM_DELAY_FINISHED_EVENT, 0);
+#endif // XINE_PARAM_DELAY_FINISHED_EVENT
+    xine_set_param(s->stream, XINE_PARAM_AUDIO_AMP_LEVEL, 100);
+    xine_set_param(s->stream, XINE_PARAM_AUDIO_CHANNEL_LOGICAL, -1);
+    xine_set_param(s->stream, XINE_PARAM_SPU_CHANNEL, -1);
+#ifdef XINE_PARAM_METRONOM_PREBUFFER
+    // a gapless switch may have left the prebuffer of the next source on the stream
+    xine_set_param(s->stream, XINE_PARAM_METRONOM_PREBUFFER, s->prebuffer);
+#endif // XINE_PARAM_METRONOM_PREBUFFER
+    s->audioPort = audioPort;
+    s->videoPort = videoPort;
+    s->sinks = sinks;
+
+    PooledXineStream *evicted = 0;
+    m_mutex.lock();
+    m_streams << s;
+    if (m_streams.size() > poolSize) {
+        evicted = m_streams.takeFirst();
+    }
+    m_mutex.unlock();
+    if (evicted) {
+        dispose(evicted);
+    }
+}
+
+void XineStreamPool::dispose(PooledXineStream *s)
+{
+    xine_event_dispose_queue(s->eventQueue);
+    // FIXME: when shutting down xine_dispose causes a crash 50% of the time, see ~XineStream
+    if (!Backend::inShutdown()) {
+        xine_dispose(s->stream);
+    }
+    delete s;
+}
+
+bool XineStreamPool::abandon(PooledXineStream *s, XineOpenJob *job, const XineOpenJobResources &resources)
+{
+    // the queue goes first, it must not outlive the stream that the job disposes
+    xine_event_dispose_queue(s->eventQueue);
+    xine_stream_t *stream = s->stream;
+    delete s;
+    if (job && job->abandon(resources)) {
+        return true;
+    }
+    // xine_open returned in the meantime
+    xine_close(stream);
+    xine_dispose(stream);
+    return false;
+}
+
+void XineStreamPool::clear()
+{
+    m_mutex.lock();
+    const QList<PooledXineStream *> streams = m_streams;
+    m_streams.clear();
+    m_mutex.unlock();
+    foreach (PooledXineStream *s, streams) {
+        dispose(s);
+    }
+}
+
+int XineStreamPool::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_streams.size();
+}
+
+} // namespace Xine
+} // namespace Phonon
+
+// vim: sw=4 ts=4 sts=4 et tw=100
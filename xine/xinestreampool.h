@@ -0,0 +1,132 @@
+/*  This file is part of the KDE project
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PHONON_XINE_XINESTREAMPOOL_H
+#define PHONON_XINE_XINESTREAMPOOL_H
+
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedData>
+
+#include <xine.h>
+
+#include "shareddata.h"
+
+namespace Phonon
+{
+namespace Xine
+{
+
+class XineOpenJob;
+struct XineOpenJobResources;
+class XineStream;
+
+/**
+ * \brief A xine_stream_t with its event queue, as handed out by XineStreamPool.
+ *
+ * The event listener thread of the queue lives as long as the stream. Its events go to the
+ * current owner, which changes when the stream is reused.
+ */
+struct PooledXineStream
+{
+    PooledXineStream(xine_stream_t *s, xine_audio_port_t *ap, xine_video_port_t *vp);
+
+    void setOwner(XineStream *owner);
+
+    xine_stream_t *const stream;
+    xine_event_queue_t *eventQueue;
+    // the ports the stream is wired to
+    xine_audio_port_t *audioPort;
+    xine_video_port_t *videoPort;
+    // false if the stream was wired to ports that are not in its key
+    bool reusable;
+    // XINE_PARAM_METRONOM_PREBUFFER of the new stream, release() restores it
+    int prebuffer;
+
+    // locked by the event listener for as long as it uses owner
+    QMutex ownerMutex;
+    XineStream *owner;
+
+    // while the stream is pooled: the sinks owning audioPort and videoPort, so that the ports
+    // stay open
+    QList<QExplicitlySharedDataPointer<SharedData> > sinks;
+};
+
+/**
+ * \brief Closed xine streams of one XineEngine, kept for reuse.
+ *
+ * Creating a xine_stream_t and its event listener thread and disposing them again is expensive
+ * when a MediaObject switches sources all the time. Instead of disposing a stream it is closed and
+ * put in the pool, keyed by the audio and video port it is wired to. The next stream that is
+ * needed for the same ports is taken from the pool.
+ *
+ * The pool must be cleared before ports that pooled streams use are closed.
+ */
+class XineStreamPool
+{
+    public:
+        XineStreamPool(xine_t *xine);
+        ~XineStreamPool();
+
+        /**
+         * Returns a stream for the given ports, either from the pool or newly created, with an
+         * event queue that calls \p listener. \p owner receives the events.
+         */
+        PooledXineStream *acquire(xine_audio_port_t *audioPort, xine_video_port_t *videoPort,
+                XineStream *owner, xine_event_listener_cb_t listener);
+
+        /**
+         * Closes the stream and keeps it for reuse. \p audioPort and \p videoPort are the ports
+         * the stream is wired to now, \p sinks the objects owning them.
+         */
+        void release(PooledXineStream *s, xine_audio_port_t *audioPort, xine_video_port_t *videoPort,
+                const QList<QExplicitlySharedDataPointer<SharedData> > &sinks);
+
+        /**
+         * Disposes the stream and its event queue.
+         */
+        void dispose(PooledXineStream *s);
+
+        /**
+         * Disposes the event queue and leaves the stream and \p resources to \p job, which is
+         * still in xine_open. Returns false if the job already finished: then the stream is
+         * disposed right away and the caller keeps \p resources.
+         */
+        bool abandon(PooledXineStream *s, XineOpenJob *job, const XineOpenJobResources &resources);
+
+        /**
+         * Disposes all pooled streams.
+         */
+        void clear();
+
+        int size() const;
+
+    private:
+        xine_t *const m_xine;
+        mutable QMutex m_mutex;
+        // least recently released first
+        QList<PooledXineStream *> m_streams;
+};
+
+} // namespace Xine
+} // namespace Phonon
+
+#endif // PHONON_XINE_XINESTREAMPOOL_H
+// vim: sw=4 ts=4 sts=4 et tw=100
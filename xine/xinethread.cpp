@@ -26,6 +26,7 @@
 #include "xinestream.h"
 #include "events.h"
 #include "backend.h"
+#include "wirecall.h"
 
 // the gcc 4.0 STL includes assert.h
 #undef assert
@@ -35,16 +36,121 @@ namespace Phonon
 namespace Xine
 {
 
+// called from main thread
+XineThread *XineThread::create()
+{
+    XineThread *thread = new XineThread;
+    thread->moveToThread(thread);
+    thread->start();
+    thread->waitForEventLoop();
+    Backend::instance()->m_threads << thread;
+    return thread;
+}
+
 XineThread *XineThread::instance()
 {
     Backend *const b = Backend::instance();
-    if (!b->m_thread) {
-        b->m_thread = new XineThread;
-        b->m_thread->moveToThread(b->m_thread);
-        b->m_thread->start();
-        b->m_thread->waitForEventLoop();
+    if (b->m_threads.isEmpty()) {
+        return create();
+    }
+    return b->m_threads.first();
+}
+
+// called from main thread: picks the thread a new XineStream is moved to
+XineThread *XineThread::threadForNewStream()
+{
+    const int maxThreads = Backend::xineThreadCount();
+    XineThread *leastBusy = instance();
+    if (maxThreads == 1) {
+        return leastBusy;
+    }
+    foreach (XineThread *thread, Backend::instance()->m_threads) {
+        if (thread->m_streamCount < leastBusy->m_streamCount) {
+            leastBusy = thread;
+        }
+    }
+    if (leastBusy->m_streamCount > 0
+            && (maxThreads <= 0 || Backend::instance()->m_threads.count() < maxThreads)) {
+        // all threads are busy and we may start another one
+        return create();
+    }
+    return leastBusy;
+}
+
+// called from main thread
+/*
+ * A connection change is split into steps, one per thread and kind of call: a graph belongs to the
+ * stream at its root and is rewired in that stream's thread. The steps of all connection changes
+ * run one after the other, the next one is posted when the previous one is done. That way a sink
+ * is always unwired from one stream before it is wired to a stream in another thread.
+ */
+struct RewireStep
+{
+    QThread *thread;
+    QList<WireCall> wireCalls;
+    QList<WireCall> unwireCalls;
+};
+
+static QMutex s_rewireMutex;
+static QList<RewireStep> s_rewireSteps;
+static bool s_rewireRunning = false;
+
+static void addRewireCall(QList<RewireStep> &steps, const WireCall &call, bool unwire)
+{
+    QThread *thread = call.thread() ? call.thread() : XineThread::instance();
+    QList<RewireStep>::Iterator it = steps.begin();
+    for (; it != steps.end() && it->thread != thread; ++it) {}
+    if (it == steps.end()) {
+        RewireStep step;
+        step.thread = thread;
+        it = steps.insert(it, step);
+    }
+    if (unwire) {
+        it->unwireCalls << call;
+    } else {
+        it->wireCalls << call;
+    }
+}
+
+// s_rewireMutex must be locked
+static void postNextRewireStep()
+{
+    if (s_rewireSteps.isEmpty()) {
+        s_rewireRunning = false;
+        return;
+    }
+    s_rewireRunning = true;
+    const RewireStep step = s_rewireSteps.takeFirst();
+    QCoreApplication::postEvent(step.thread, new RewireEvent(step.wireCalls, step.unwireCalls));
+}
+
+void XineThread::postRewire(const QList<WireCall> &wireCalls, const QList<WireCall> &unwireCalls)
+{
+    // the order of the calls per thread is kept, all unwire calls go before the wire calls
+    QList<RewireStep> steps;
+    foreach (const WireCall &unwire, unwireCalls) {
+        addRewireCall(steps, unwire, true);
+    }
+    QList<RewireStep> wireSteps;
+    foreach (const WireCall &wire, wireCalls) {
+        addRewireCall(wireSteps, wire, false);
+    }
+    steps += wireSteps;
+
+    QMutexLocker lock(&s_rewireMutex);
+    foreach (const RewireStep &step, steps) {
+        // a step for the same thread can be merged as long as unwire calls still come first
+        if (!s_rewireSteps.isEmpty() && s_rewireSteps.last().thread == step.thread
+                && (step.unwireCalls.isEmpty() || s_rewireSteps.last().wireCalls.isEmpty())) {
+            s_rewireSteps.last().unwireCalls += step.unwireCalls;
+            s_rewireSteps.last().wireCalls += step.wireCalls;
+        } else {
+            s_rewireSteps << step;
+        }
+    }
+    if (!s_rewireRunning) {
+        postNextRewireStep();
     }
-    return b->m_thread;
 }
 
 XineThread::XineThread()
@@ -57,6 +163,27 @@ XineThread::~XineThread()
 {
 }
 
+// any thread
+void XineThread::addCleanupObject(QObject *o)
+{
+    QMutexLocker lock(&m_cleanupMutex);
+    m_cleanupObjects << o;
+}
+
+// any thread
+void XineThread::removeCleanupObject(QObject *o)
+{
+    QMutexLocker lock(&m_cleanupMutex);
+    m_cleanupObjects.removeAll(o);
+}
+
+// any thread
+bool XineThread::hasCleanupObjects()
+{
+    QMutexLocker lock(&m_cleanupMutex);
+    return !m_cleanupObjects.isEmpty();
+}
+
 // called from main thread
 // should never be called from ByteStream
 void XineThread::waitForEventLoop()
@@ -70,7 +197,8 @@ void XineThread::waitForEventLoop()
 
 XineStream *XineThread::newStream()
 {
-    XineThread *that = XineThread::instance();
+    XineThread *that = threadForNewStream();
+    that->m_streamCount.ref();
 
     QMutexLocker locker(&that->m_mutex);
     Q_ASSERT(that->m_newStream == 0);
@@ -96,7 +224,10 @@ bool XineThread::event(QEvent *e)
     case Event::Cleanup:
         e->accept();
         {
-            const QList<QObject *> cleanupObjects = Backend::cleanupObjects();
+            // only this thread deletes the objects in its list, their destructors remove them
+            m_cleanupMutex.lock();
+            const QList<QObject *> cleanupObjects = m_cleanupObjects;
+            m_cleanupMutex.unlock();
             foreach (QObject *o, cleanupObjects) {
                 delete o;
             }
@@ -108,6 +239,7 @@ bool XineThread::event(QEvent *e)
         Q_ASSERT(m_newStream == 0);
         m_newStream = new XineStream;
         m_newStream->moveToThread(this);
+        connect(m_newStream, SIGNAL(destroyed()), SLOT(streamDestroyed()), Qt::DirectConnection);
         m_mutex.unlock();
         m_waitingForNewStream.wakeAll();
         return true;
@@ -130,6 +262,10 @@ bool XineThread::event(QEvent *e)
                 wire.sink->rewireTo(wire.source.data());
             }
         }
+        {
+            QMutexLocker lock(&s_rewireMutex);
+            postNextRewireStep();
+        }
         return true;
     default:
         return QThread::event(e);
@@ -152,6 +288,12 @@ void XineThread::run()
     }
 }
 
+// xine thread
+void XineThread::streamDestroyed()
+{
+    m_streamCount.deref();
+}
+
 // xine thread
 void XineThread::eventLoopReady()
 {
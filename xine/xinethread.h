@@ -21,6 +21,8 @@
 #ifndef PHONON_XINE_XINETHREAD_H
 #define PHONON_XINE_XINETHREAD_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutex>
@@ -30,12 +32,21 @@ namespace Phonon
 namespace Xine
 {
 class XineStream;
+class WireCall;
 
+/**
+ * \brief A worker thread running XineStreams.
+ *
+ * Every XineStream lives in one XineThread for its whole life. How many XineThreads are used is
+ * configured with Settings/xineThreads: 1 runs all streams in one thread, 0 gives every stream a
+ * thread of its own and N > 1 distributes the streams over up to N threads.
+ */
 class XineThread : public QThread
 {
     friend class Backend;
     Q_OBJECT
     public:
+        // the first XineThread, for everything that doesn't belong to a stream
         static XineThread *instance();
 
         XineThread();
@@ -43,21 +54,38 @@ class XineThread : public QThread
 
         void waitForEventLoop();
         static XineStream *newStream();
+        // posts the rewire calls to the threads of the streams the wires belong to, one thread
+        // after the other
+        static void postRewire(const QList<WireCall> &wireCalls, const QList<WireCall> &unwireCalls);
         void quit();
 
+        // the KeepReference objects living in this thread, the Cleanup event deletes them
+        void addCleanupObject(QObject *o);
+        void removeCleanupObject(QObject *o);
+        bool hasCleanupObjects();
+
     protected:
         void run();
         bool event(QEvent *e);
 
     private slots:
         void eventLoopReady();
+        void streamDestroyed();
 
     private:
+        static XineThread *create();
+        static XineThread *threadForNewStream();
+
+        // the number of XineStreams living in this thread
+        QAtomicInt m_streamCount;
         QMutex m_mutex;
         QWaitCondition m_waitingForEventLoop;
         QWaitCondition m_waitingForNewStream;
         XineStream *m_newStream;
         bool m_eventLoopReady;
+        // guards m_cleanupObjects, which is filled from the main thread and emptied in this thread
+        QMutex m_cleanupMutex;
+        QList<QObject *> m_cleanupObjects;
 };
 
 } // namespace Xine